@@ -0,0 +1,16 @@
+// Totals for the last batch of forkp() processes to finish,
+// returned by batchstat().  Times are in ticks.
+
+struct batchstat {
+  int seq;           // Batches finished since boot
+  int policy;        // Scheduling policy when the batch ended
+  int nproc;         // Processes in the batch
+  int exectime;      // First start to last exit
+  int turnaround;    // Sum of turn-around times
+  int waiting;       // Sum of time spent in the ready queue
+  int completion;    // Sum of completion times
+  int nbursts;       // CPU bursts
+  int bursts;        // Sum of CPU burst lengths
+  int nerrors;       // Bursts that had an SJF estimate
+  int error;         // Sum of |estimate - burst| over those
+};
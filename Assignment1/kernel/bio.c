@@ -1,10 +1,17 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Buffers are hashed on (dev, blockno) into NBUCKET chains, each
+// protected by its own spinlock, so lookups of different blocks
+// on different harts do not contend.  Recycling uses a clock
+// (second-chance) sweep over bcache.buf[]: brelse sets a buffer's
+// reference bit and the sweep clears it once before reusing the
+// buffer, which approximates LRU without a global list.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
@@ -23,78 +30,176 @@
 #include "fs.h"
 #include "buf.h"
 
+#define BHASH(dev, blockno) ((((uint64)(dev) << 32) | (blockno)) % NBUCKET)
+
+struct bucket {
+  struct spinlock lock;
+  struct buf head;    // hash chain, through prev/next
+};
+
 struct {
+  // Serializes recycling, so that at most one process at a time
+  // moves a buffer between hash chains.  Lookups that hit never
+  // take it.
   struct spinlock lock;
   struct buf buf[NBUF];
+  int hand;           // clock hand into buf[], protected by lock
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  struct bucket bucket[NBUCKET];
 } bcache;
 
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // All buffers start out unused on chain 0.  dev 0 is never
+  // a real device, so they cannot produce false hits.
+  bk = &bcache.bucket[0];
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+    b->next = bk->head.next;
+    b->prev = &bk->head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bk->head.next->prev = b;
+    bk->head.next = b;
+  }
+}
+
+// Look for block on device dev in chain bk.
+// Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head.next; b != &bk->head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
   }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// If ahead is set (read-ahead), return 0 instead of waiting
+// for a cached buffer or panicking when none is free.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ahead)
 {
   struct buf *b;
+  struct bucket *bk, *vk;
+  int i;
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(dev, blockno)];
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(ahead){
+      release(&bk->lock);
+      return 0;
     }
+    b->refcnt++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Not cached.  Only holders of bcache.lock insert into a chain,
+  // so once we hold it, a second miss on bk is final.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(ahead){
+      release(&bk->lock);
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
     }
+    b->refcnt++;
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
+
+  // Sweep the clock hand for an unused buffer whose reference bit
+  // is clear.  Two full turns are enough to clear every bit.
+  // A buffer's chain cannot change while we hold bcache.lock.
+  for(i = 0; i < 2*NBUF; i++){
+    b = &bcache.buf[bcache.hand];
+    bcache.hand = (bcache.hand + 1) % NBUF;
+
+    vk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    acquire(&vk->lock);
+    if(b->refcnt != 0){
+      release(&vk->lock);
+      continue;
+    }
+    if(b->used){
+      b->used = 0;
+      release(&vk->lock);
+      continue;
+    }
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    release(&vk->lock);
+
+    // b is on no chain, so no one else can find it.
+    b->dev = dev;
+    b->blockno = blockno;
+    b->valid = 0;
+    b->refcnt = 1;
+
+    acquire(&bk->lock);
+    b->next = bk->head.next;
+    b->prev = &bk->head;
+    bk->head.next->prev = b;
+    bk->head.next = b;
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.lock);
+  if(ahead)
+    return 0;
   panic("bget: no buffers");
 }
 
+// Drop a reference to b.  Once unreferenced, mark it
+// recently used so the clock sweep passes it over once.
+static void
+bunref(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    b->used = 1;
+  }
+  release(&bk->lock);
+}
+
 // Return a locked buf with the contents of the indicated block.
 struct buf*
 bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
@@ -102,6 +207,50 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buffer for block blockno of dev, without
+// reading the disk, for a caller that will overwrite all
+// of its contents.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno, 0);
+  b->valid = 1;
+  return b;
+}
+
+// Queue a read of block blockno of dev into the cache, without
+// waiting for the disk.  Does nothing if the block is already
+// cached or no buffer is free.  The buffer stays locked until
+// virtio_disk_intr() calls bdone(), so a bread() of the block
+// sleeps until the data has arrived.  Call bkick() after
+// queueing a batch so the disk starts on it.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return;
+  if(b->valid){
+    brelse(b);
+    return;
+  }
+  virtio_disk_submit(b, 0);
+}
+
+// Called by virtio_disk_intr() when a read started by
+// breadahead() completes.  Runs in interrupt context, so
+// releases b on behalf of the process that started the read.
+void
+bdone(struct buf *b)
+{
+  b->valid = 1;
+  releasesleep(&b->lock);
+  bunref(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,8 +260,35 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Queue a write of b's contents to disk and return
+// without waiting.  b must stay locked until bwait(b).
+// Writes queued together are merged into as few disk
+// requests as block adjacency allows.
+void
+bwrite_async(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_async");
+  virtio_disk_start(b, 1);
+}
+
+// Wait for a write queued by bwrite_async() to finish.
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  virtio_disk_wait(b);
+}
+
+// Start all queued disk requests.
+void
+bkick(void)
+{
+  virtio_disk_kick();
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +296,19 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
-
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  bunref(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
-  b->refcnt--;
-  release(&bcache.lock);
+  bunref(b);
 }
-
-
@@ -1,11 +1,15 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  int async;   // release via bdone() on completion (read-ahead)?
+  int qwrite;  // queued disk request is a write?
+  struct buf *qnext; // disk queue, or next buf in the same request
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint used;   // clock reference bit, set on release
+  struct buf *prev; // hash chain
   struct buf *next;
   uchar data[BSIZE];
 };
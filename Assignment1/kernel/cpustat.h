@@ -0,0 +1,8 @@
+// Per-CPU scheduling statistics, returned by cpustat().
+// Times are in time CSR counts (10 MHz).
+
+struct cpustat {
+  uint64 time;       // time CSR when sampled
+  uint64 busy;       // Time spent running processes
+  uint64 nswitch;    // Switches to a process
+};
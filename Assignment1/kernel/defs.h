@@ -4,7 +4,9 @@
 struct buf;
 struct context;
 struct file;
+struct iovec;
 struct inode;
+struct logstat;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -15,6 +17,12 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
+void            breadahead(uint, uint);
+void            bdone(struct buf*);
+void            bwrite_async(struct buf*);
+void            bwait(struct buf*);
+void            bkick(void);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
@@ -36,10 +44,14 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filesplice(struct file*, struct file*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+void            dcache_enter(struct inode*, char*, uint, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
@@ -55,6 +67,7 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             writei_ordered(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 
 // ramdisk.c
@@ -72,12 +85,22 @@ void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            begin_opn(int);
+void            end_opn(int);
+int             log_busy(uint);
+void            log_free(uint);
+void            logstat(struct logstat*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
+int             pipewritev(struct pipe*, struct iovec*, int);
+int             pipespliced(struct pipe*, char**, int);
+int             pipesplicew(struct pipe*, char**, int);
+void            pipesplicedone(struct pipe*, int, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -89,7 +112,6 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -113,8 +135,13 @@ int		forkf(uint64);
 int		waitpid(int, uint64);
 int		ps(void);
 int		pinfo(int, uint64);
+int             procsnapshot(uint64, int);
+int             cpustat(uint64, int);
+int             batchstat(uint64);
+void            chargetime(struct proc*, int);
 int		forkp(int);
 int		schedpolicy(int);
+int             setmaxproc(int);
 void            bufferinit(void);
 void            barrinit(void);
 void            barrier(int,int,int);
@@ -155,6 +182,7 @@ int             argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             sysstat(uint64, int);
 
 // trap.c
 extern uint     ticks;
@@ -163,17 +191,25 @@ void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
 
+// trace.c
+void            traceinit(void);
+void            trace(int, int, uint64, uint64);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 void            uartputc_sync(int);
+void            uartwrite(char*, int);
+void            uartwrite_async(char*, int);
+void            uartflush_sync(void);
 int             uartgetc(void);
 
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+int             kvmmapstack(uint64, uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
@@ -197,6 +233,10 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_start(struct buf *, int);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_kick(void);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
 
 // condvar.c
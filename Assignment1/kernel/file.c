@@ -12,17 +12,31 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "iovec.h"
 
 struct devsw devsw[NDEV];
+
+// f->ref is updated atomically, so filedup() and any
+// fileclose() that does not drop the last reference take
+// no lock.  ftable.lock protects only the free list of
+// unreferenced files, used by filealloc() and by the last
+// fileclose().
 struct {
   struct spinlock lock;
   struct file file[NFILE];
+  struct file *free;
 } ftable;
 
 void
 fileinit(void)
 {
+  struct file *f;
+
   initlock(&ftable.lock, "ftable");
+  for(f = ftable.file + NFILE - 1; f >= ftable.file; f--){
+    f->next = ftable.free;
+    ftable.free = f;
+  }
 }
 
 // Allocate a file structure.
@@ -32,26 +46,21 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if((f = ftable.free) != 0){
+    ftable.free = f->next;
+    f->next = 0;
+    f->ref = 1;
   }
   release(&ftable.lock);
-  return 0;
+  return f;
 }
 
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(__sync_fetch_and_add(&f->ref, 1) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -60,17 +69,20 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  int ref;
 
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  ref = __sync_sub_and_fetch(&f->ref, 1);
+  if(ref < 0)
     panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if(ref > 0)
     return;
-  }
+
+  // no one else refers to f now.
   ff = *f;
-  f->ref = 0;
   f->type = FD_NONE;
+  acquire(&ftable.lock);
+  f->next = ftable.free;
+  ftable.free = f;
   release(&ftable.lock);
 
   if(ff.type == FD_PIPE){
@@ -152,19 +164,30 @@ filewrite(struct file *f, uint64 addr, int n)
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
+    // a large write instead streams up to NSTREAM blocks
+    // per transaction straight to their home locations,
+    // logging only the metadata.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
     while(i < n){
       int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
+      if(n1 > max){
+        if(n1 > NSTREAM*BSIZE)
+          n1 = NSTREAM*BSIZE;
+        begin_opn(NSTREAM + MAXOPBLOCKS);
+        ilock(f->ip);
+        if ((r = writei_ordered(f->ip, 1, addr + i, f->off, n1)) > 0)
+          f->off += r;
+        iunlock(f->ip);
+        end_opn(NSTREAM + MAXOPBLOCKS);
+      } else {
+        begin_op();
+        ilock(f->ip);
+        if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+          f->off += r;
+        iunlock(f->ip);
+        end_op();
+      }
 
       if(r != n1){
         // error from writei
@@ -180,3 +203,143 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Read from file f into the niov user buffers in iov,
+// stopping at the first short read.
+// An inode is locked once for the whole call.
+int
+filereadv(struct file *f, struct iovec *iov, int niov)
+{
+  int i, n, r = 0, tot = 0;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE)
+    return pipereadv(f->pipe, iov, niov);
+
+  if(f->type == FD_INODE)
+    ilock(f->ip);
+  for(i = 0; i < niov; i++){
+    n = iov[i].iov_len;
+    if(f->type == FD_INODE){
+      if((r = readi(f->ip, 1, (uint64)iov[i].iov_base, f->off, n)) > 0)
+        f->off += r;
+    } else {
+      r = fileread(f, (uint64)iov[i].iov_base, n);
+    }
+    if(r > 0)
+      tot += r;
+    if(r != n)
+      break;
+  }
+  if(f->type == FD_INODE)
+    iunlock(f->ip);
+
+  return (r < 0 && tot == 0) ? -1 : tot;
+}
+
+// Write the niov user buffers in iov to file f.
+// If they fit in one transaction, an inode write
+// takes a single begin_op() and ilock().
+int
+filewritev(struct file *f, struct iovec *iov, int niov)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i, n, r = 0, tot = 0;
+  uint64 len = 0;
+
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE)
+    return pipewritev(f->pipe, iov, niov);
+
+  for(i = 0; i < niov; i++)
+    len += iov[i].iov_len;
+  if(f->type == FD_INODE && len <= max){
+    begin_op();
+    ilock(f->ip);
+    for(i = 0; i < niov; i++){
+      n = iov[i].iov_len;
+      if((r = writei(f->ip, 1, (uint64)iov[i].iov_base, f->off, n)) > 0){
+        f->off += r;
+        tot += r;
+      }
+      if(r != n)
+        break;
+    }
+    iunlock(f->ip);
+    end_op();
+    return i == niov ? tot : -1;
+  }
+
+  for(i = 0; i < niov; i++){
+    if((r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len)) < 0)
+      return -1;
+    tot += r;
+  }
+  return tot;
+}
+
+// Move up to n bytes from file fin to file fout inside the
+// kernel, one of them a pipe and the other an inode.  The
+// data is copied once, between the buffer cache and the
+// pipe's ring, never through user space.
+// Returns the number of bytes moved, or -1 if none could be.
+int
+filesplice(struct file *fin, struct file *fout, int n)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int m, r, tot = 0;
+  char *p;
+
+  if(fin->readable == 0 || fout->writable == 0 || n < 0)
+    return -1;
+
+  if(fin->type == FD_INODE && fout->type == FD_PIPE){
+    while(tot < n){
+      if((m = pipesplicew(fout->pipe, &p, n - tot)) < 0)
+        break;
+      ilock(fin->ip);
+      if((r = readi(fin->ip, 0, (uint64)p, fin->off, m)) > 0)
+        fin->off += r;
+      iunlock(fin->ip);
+      pipesplicedone(fout->pipe, 1, r > 0 ? r : 0);
+      if(r <= 0){
+        if(r == 0)
+          return tot;  // end of file
+        break;
+      }
+      tot += r;
+    }
+    return (tot == n || tot > 0) ? tot : -1;
+  }
+
+  if(fin->type == FD_PIPE && fout->type == FD_INODE){
+    while(tot < n){
+      m = n - tot;
+      if(m > max)
+        m = max;
+      if((m = pipespliced(fin->pipe, &p, m)) <= 0){
+        if(m == 0)
+          return tot;  // end of file
+        break;
+      }
+      begin_op();
+      ilock(fout->ip);
+      if((r = writei(fout->ip, 0, (uint64)p, fout->off, m)) > 0)
+        fout->off += r;
+      iunlock(fout->ip);
+      end_op();
+      pipesplicedone(fin->pipe, 0, r > 0 ? r : 0);
+      if(r > 0)
+        tot += r;
+      if(r != m)
+        break;
+    }
+    return (tot == n || tot > 0) ? tot : -1;
+  }
+
+  return -1;
+}
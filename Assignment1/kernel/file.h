@@ -7,6 +7,7 @@ struct file {
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  struct file *next; // ftable free list, when ref == 0
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -18,6 +19,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hprev; // hash chain
+  struct inode *hnext;
+  struct inode *lprev; // LRU list of unreferenced inodes
+  struct inode *lnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +31,11 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+2];
+
+  uint ralast;        // last block readi() read, for read-ahead
+  uint raend;         // blocks below this have been read ahead
+  uint bnext;         // where bmap() next looks for a free block
 };
 
 // map major device number to device functions.
@@ -38,3 +47,4 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define TRACE 2
@@ -26,6 +26,24 @@
 // only one device
 struct superblock sb; 
 
+// Blocks per allocation group.  Divides BPB, so each
+// group's bits lie in a single bitmap block.
+#define BGROUP 64
+#define NBGROUP ((FSSIZE + BGROUP - 1) / BGROUP)
+
+// In-memory summary of the free bitmap: the number of free
+// blocks in each group, so balloc() can skip full groups
+// without reading their bitmap block.  Loaded by fsinit().
+// A group's count only changes while its bitmap block's
+// buffer is locked, alongside the bits themselves; reads
+// without that lock are just hints.
+struct {
+  int ngroup;
+  uchar nfree[NBGROUP];
+} bsum;
+
+static void bsuminit(int dev);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +62,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
 }
 
 // Zero a block.
@@ -60,24 +79,64 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+// Count the free blocks in each group of the bitmap.
+// Called after log recovery, so the bitmap is current.
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
+  uint b, bi;
   struct buf *bp;
 
+  bsum.ngroup = (sb.size + BGROUP - 1) / BGROUP;
+  if(bsum.ngroup > NBGROUP)
+    panic("bsuminit: file system larger than FSSIZE");
   bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+  for(b = 0; b < sb.size; b++){
+    bi = b % BPB;
+    if(bi == 0){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, BBLOCK(b, sb));
+    }
+    if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+      bsum.nfree[b / BGROUP]++;
+  }
+  if(bp)
+    brelse(bp);
+}
+
+// Allocate a disk block, preferring the first
+// free block at or after goal, so that blocks allocated
+// one after another for a file end up adjacent on disk.
+// Groups that bsum says are full are skipped without
+// touching the disk, so the cost does not grow as the
+// disk fills.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b, g, g0, i, bi, m;
+  struct buf *bp;
+
+  if(goal >= sb.size)
+    goal = 0;
+  g0 = goal / BGROUP;
+  // Visit goal's group twice: first from goal,
+  // then from its start after wrapping around.
+  for(i = 0; i <= bsum.ngroup; i++){
+    g = (g0 + i) % bsum.ngroup;
+    if(bsum.nfree[g] == 0)
+      continue;
+    bp = bread(dev, BBLOCK(g * BGROUP, sb));
+    b = (i == 0) ? goal : g * BGROUP;
+    for(; b < (g + 1) * BGROUP && b < sb.size; b++){
+      bi = b % BPB;
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
+        bsum.nfree[g]--;
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
+        return b;
       }
     }
     brelse(bp);
@@ -98,7 +157,9 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  bsum.nfree[b / BGROUP]++;
   log_write(bp);
+  log_free(b);
   brelse(bp);
 }
 
@@ -162,28 +223,98 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// The inode table is a hash table keyed on (dev, inum), with
+// a spin-lock per chain.  iget() holds a chain's lock while it
+// searches the chain and while ip->ref moves between 0 and 1,
+// so lookups of different inodes do not contend.  idup() never
+// takes a lock: ip->ref is updated atomically and the caller
+// already holds a reference.
+//
+// Entries with ip->ref == 0 stay on their chain, still valid,
+// and on an LRU list, so an inode that is closed and soon
+// reopened is found without reading the disk.  The itable.lock
+// spin-lock protects the LRU list and serializes recycling,
+// the only time an entry moves between chains; so one must
+// hold itable.lock or the entry's chain lock while using
+// ip->dev or ip->inum of an entry one holds no reference to.
+// Lock order: itable.lock, then a chain lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define IHASH(dev, inum) ((((uint64)(dev) << 32) | (inum)) % NIBUCKET)
+
+struct ibucket {
+  struct spinlock lock;
+  struct inode head;    // hash chain, through hprev/hnext
+};
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+
+  // Unreferenced entries, through lprev/lnext.
+  // lru.lnext is least recently used.
+  struct inode lru;
+
+  struct ibucket bucket[NIBUCKET];
 } itable;
 
+// Append ip to the LRU list, moving it if it is already there.
+// Caller must hold itable.lock.
+static void
+lru_push(struct inode *ip)
+{
+  if(ip->lnext){
+    ip->lnext->lprev = ip->lprev;
+    ip->lprev->lnext = ip->lnext;
+  }
+  ip->lprev = itable.lru.lprev;
+  ip->lnext = &itable.lru;
+  itable.lru.lprev->lnext = ip;
+  itable.lru.lprev = ip;
+}
+
+// Remove ip from the LRU list.
+// Caller must hold itable.lock.
+static void
+lru_remove(struct inode *ip)
+{
+  ip->lnext->lprev = ip->lprev;
+  ip->lprev->lnext = ip->lnext;
+  ip->lnext = ip->lprev = 0;
+}
+
+static void dcacheinit(void);
+static void dcache_purge(uint dev, uint inum);
+
 void
 iinit()
 {
   int i = 0;
+  struct ibucket *bk;
+  struct inode *ip;
   
   initlock(&itable.lock, "itable");
+  dcacheinit();
+  itable.lru.lprev = itable.lru.lnext = &itable.lru;
+  for(bk = itable.bucket; bk < itable.bucket+NIBUCKET; bk++){
+    initlock(&bk->lock, "itable.bucket");
+    bk->head.hprev = bk->head.hnext = &bk->head;
+  }
+
+  // All entries start out unreferenced on chain 0, where
+  // inum 0 (never a real inode) keeps them from matching.
+  bk = &itable.bucket[0];
   for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    ip = &itable.inode[i];
+    initsleeplock(&ip->lock, "inode");
+    ip->hnext = bk->head.hnext;
+    ip->hprev = &bk->head;
+    bk->head.hnext->hprev = ip;
+    bk->head.hnext = ip;
+    lru_push(ip);
   }
 }
 
@@ -236,40 +367,85 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Look for inode inum on device dev in chain bk and
+// take a reference to it.  Caller must hold bk->lock.
+static struct inode*
+ifind(struct ibucket *bk, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = bk->head.hnext; ip != &bk->head; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      __sync_fetch_and_add(&ip->ref, 1);
+      return ip;
+    }
+  }
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  struct ibucket *bk, *vk;
 
-  acquire(&itable.lock);
+  bk = &itable.bucket[IHASH(dev, inum)];
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  acquire(&bk->lock);
+  ip = ifind(bk, dev, inum);
+  release(&bk->lock);
+  if(ip)
+    return ip;
+
+  // Only holders of itable.lock insert into a chain,
+  // so once we hold it, a second miss on bk is final.
+  acquire(&itable.lock);
+  acquire(&bk->lock);
+  ip = ifind(bk, dev, inum);
+  release(&bk->lock);
+  if(ip){
+    release(&itable.lock);
+    return ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->valid = 0;
-  release(&itable.lock);
-
-  return ip;
+  // Recycle the least recently used unreferenced entry.
+  // iget() may have revived entries still on the list;
+  // drop those as they turn up.
+  while((ip = itable.lru.lnext) != &itable.lru){
+    lru_remove(ip);
+    vk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+    acquire(&vk->lock);
+    if(ip->ref != 0){
+      release(&vk->lock);
+      continue;
+    }
+    ip->hnext->hprev = ip->hprev;
+    ip->hprev->hnext = ip->hnext;
+    release(&vk->lock);
+
+    // ip is on no chain, so no one else can find it.
+    ip->dev = dev;
+    ip->inum = inum;
+    ip->ref = 1;
+    ip->valid = 0;
+    ip->ralast = -1;
+    ip->raend = 0;
+    ip->bnext = 0;
+
+    acquire(&bk->lock);
+    ip->hnext = bk->head.hnext;
+    ip->hprev = &bk->head;
+    bk->head.hnext->hprev = ip;
+    bk->head.hnext = ip;
+    release(&bk->lock);
+    release(&itable.lock);
+    return ip;
+  }
+  panic("iget: no inodes");
 }
 
 // Increment reference count for ip.
@@ -277,9 +453,7 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
-  ip->ref++;
-  release(&itable.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
   return ip;
 }
 
@@ -332,7 +506,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *bk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&bk->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -341,8 +517,10 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(&bk->lock);
 
+    if(ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
@@ -350,11 +528,20 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquire(&bk->lock);
   }
 
-  ip->ref--;
-  release(&itable.lock);
+  if(__sync_sub_and_fetch(&ip->ref, 1) == 0){
+    release(&bk->lock);
+    // Keep the entry cached.  If iget() recycles or revives it
+    // before we get here, lru_push() merely queues an entry
+    // that iget() will skip.
+    acquire(&itable.lock);
+    lru_push(ip);
+    release(&itable.lock);
+    return;
+  }
+  release(&bk->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -370,19 +557,55 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The next NDINDIRECT
+// blocks are listed in blocks that are themselves listed in
+// block ip->addrs[NDIRECT+1].
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Allocate a block for ip: next to block prev if it is
+// set, else where ip's previous allocation left off.
+// Zero it unless the caller is about to overwrite all of it.
 static uint
-bmap(struct inode *ip, uint bn)
+iballoc(struct inode *ip, uint prev, int zero)
 {
-  uint addr, *a;
+  uint addr;
+
+  addr = balloc(ip->dev, prev ? prev + 1 : ip->bnext);
+  ip->bnext = addr + 1;
+  if(zero)
+    bzero(ip->dev, addr);
+  return addr;
+}
+
+// Return the block number in slot i of indirect block addr.
+// If there is no such block, allocate one next to the
+// block in the previous slot, zeroed if zero is set.
+static uint
+bmapind(struct inode *ip, uint addr, uint i, int zero)
+{
+  uint *a;
   struct buf *bp;
 
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = iballoc(ip, i > 0 ? a[i-1] : bp->blockno, zero);
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one, zeroed
+// unless zero is 0 because the caller will overwrite it.
+static uint
+bmap(struct inode *ip, uint bn, int zero)
+{
+  uint addr;
+
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = iballoc(ip, bn > 0 ? ip->addrs[bn-1] : 0, zero);
     return addr;
   }
   bn -= NDIRECT;
@@ -390,28 +613,53 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
-    }
-    brelse(bp);
-    return addr;
+      ip->addrs[NDIRECT] = addr = iballoc(ip, ip->addrs[NDIRECT-1], 1);
+    return bmapind(ip, addr, bn, zero);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double-indirect block, then the indirect
+    // block it lists for bn, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = iballoc(ip, ip->addrs[NDIRECT], 1);
+    addr = bmapind(ip, addr, bn / NINDIRECT, 1);
+    return bmapind(ip, addr, bn % NINDIRECT, zero);
   }
 
   panic("bmap: out of range");
 }
 
+// Free indirect block addr and the blocks it lists.
+// If depth > 1, the listed blocks are themselves
+// indirect blocks of depth-1.
+static void
+itruncind(struct inode *ip, uint addr, int depth)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(depth > 1)
+      itruncind(ip, a[j], depth - 1);
+    else
+      bfree(ip->dev, a[j]);
+  }
+  brelse(bp);
+  bfree(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -421,17 +669,15 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip, ip->addrs[NDIRECT], 1);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    itruncind(ip, ip->addrs[NDIRECT+1], 2);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
@@ -448,6 +694,39 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Called by readi() after reading block bn of ip.
+// If readi has been walking ip block by block, start
+// asynchronous reads of the next NREADAHEAD blocks so
+// they are in the cache by the time readi asks for them.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint end, nblocks;
+
+  if(bn == ip->ralast)
+    return;
+  if(bn != ip->ralast + 1){
+    // random access; start a new window.
+    ip->ralast = bn;
+    ip->raend = bn + 1;
+    return;
+  }
+  ip->ralast = bn;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = bn + 1 + NREADAHEAD;
+  if(end > nblocks)
+    end = nblocks;
+  if(ip->raend < bn + 1)
+    ip->raend = bn + 1;
+  if(ip->raend >= end)
+    return;
+  for(; ip->raend < end; ip->raend++)
+    breadahead(ip->dev, bmap(ip, ip->raend, 1));
+  bkick();
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -464,7 +743,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
+    readahead(ip, off/BSIZE);
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
@@ -483,25 +763,69 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 // Returns the number of bytes successfully written.
 // If the return value is less than the requested n,
 // there was an error of some kind.
-int
-writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+// If ordered is set, blocks the write covers entirely are
+// written straight to their home location, not through the
+// log, and the write waits for them; since the transaction's
+// metadata commits later, a crash exposes either the old
+// file or the new data, never unwritten blocks.  Blocks the
+// log still holds, or that were freed since the last commit
+// and so may still belong to another file on disk, go
+// through the log as usual.
+static int
+writei1(struct inode *ip, int user_src, uint64 src, uint off, uint n, int ordered)
 {
-  uint tot, m;
-  struct buf *bp;
+  uint tot, m, addr;
+  int direct, fresh, nq = 0;
+  struct buf *bp, *q[NSTREAM];
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ordered && n > NSTREAM*BSIZE)
+    panic("writei: ordered write too big");
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    direct = 0;
+    // a block past the old end of file holds nothing of
+    // this file's yet, so it may be zeroed on a failure.
+    fresh = off >= ip->size;
+    if(ordered && m == BSIZE){
+      addr = bmap(ip, off/BSIZE, 0);
+      direct = !log_busy(addr);
+    } else {
+      addr = bmap(ip, off/BSIZE, 1);
+    }
+    bp = direct ? bnew(ip->dev, addr) : bread(ip->dev, addr);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
-      brelse(bp);
+      if(direct && fresh){
+        // the block may be new and hold an old file's data.
+        memset(bp->data, 0, BSIZE);
+        bwrite_async(bp);
+        q[nq++] = bp;
+      } else if(direct){
+        // bnew() never read the old contents, which are
+        // still intact on disk.
+        bp->valid = 0;
+        brelse(bp);
+      } else {
+        brelse(bp);
+      }
       break;
     }
-    log_write(bp);
+    if(direct){
+      bwrite_async(bp);
+      q[nq++] = bp;
+    } else {
+      log_write(bp);
+      brelse(bp);
+    }
+  }
+
+  while(nq > 0){
+    bp = q[--nq];
+    bwait(bp);
     brelse(bp);
   }
 
@@ -516,6 +840,20 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+int
+writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  return writei1(ip, user_src, src, off, n, 0);
+}
+
+// Like writei(), but write whole blocks in place rather than
+// through the log.  n must be at most NSTREAM*BSIZE.
+int
+writei_ordered(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  return writei1(ip, user_src, src, off, n, 1);
+}
+
 // Directories
 
 int
@@ -524,20 +862,322 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory name lookup cache.
+//
+// Remembers the results of recent dirlookup()s, both hits
+// (name -> inum and dirent offset) and misses, so that namex()
+// need not rescan a directory for every path element.
+// Entries for directory dp are only made, changed or used
+// while dp is locked, which keeps them in step with dp's
+// contents: dirlink() and sys_unlink() update them as they
+// change dp, and iput() purges a directory's entries when its
+// inode is freed, since the inum may be reused.
+
+#define DCWAYS 4
+#define NDCSET (NDENTRY / DCWAYS)
+
+struct dentry {
+  uint dev;
+  uint dinum;         // directory's inum; 0 if unused
+  char name[DIRSIZ];
+  uint inum;          // 0 for a negative entry
+  uint off;           // byte offset of dirent in directory
+};
+
+// A set of DCWAYS entries sharing a hash value.
+struct dcset {
+  struct spinlock lock;
+  int next;           // round-robin victim
+  struct dentry e[DCWAYS];
+};
+
+struct dcset dcache[NDCSET];
+
+static void
+dcacheinit(void)
+{
+  int i;
+
+  for(i = 0; i < NDCSET; i++)
+    initlock(&dcache[i].lock, "dcache");
+}
+
+static struct dcset*
+dchash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache[h % NDCSET];
+}
+
+// Return the cached entry for name in dp, or 0.
+// Caller must hold the set's lock.
+static struct dentry*
+dcfind(struct dcset *s, struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = s->e; d < s->e + DCWAYS; d++){
+    if(d->dinum == dp->inum && d->dev == dp->dev && namecmp(d->name, name) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Look up name in dp's cached entries.  If found, return 1 and
+// set *inum (0 for a known miss) and *off.
+// Caller must hold dp->lock.
+static int
+dcache_lookup(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dcset *s = dchash(dp->dev, dp->inum, name);
+  struct dentry *d;
+  int found = 0;
+
+  acquire(&s->lock);
+  if((d = dcfind(s, dp, name)) != 0){
+    *inum = d->inum;
+    *off = d->off;
+    found = 1;
+  }
+  release(&s->lock);
+  return found;
+}
+
+// Record that name in dp is inode inum at offset off,
+// or, if inum is 0, that dp has no entry name.
+// Caller must hold dp->lock.
+void
+dcache_enter(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dcset *s = dchash(dp->dev, dp->inum, name);
+  struct dentry *d;
+
+  acquire(&s->lock);
+  if((d = dcfind(s, dp, name)) == 0){
+    for(d = s->e; d < s->e + DCWAYS; d++){
+      if(d->dinum == 0)
+        break;
+    }
+    if(d == s->e + DCWAYS){
+      d = &s->e[s->next];
+      s->next = (s->next + 1) % DCWAYS;
+    }
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+  }
+  d->inum = inum;
+  d->off = off;
+  release(&s->lock);
+}
+
+// Forget all entries for directory inum on dev.
+static void
+dcache_purge(uint dev, uint inum)
+{
+  struct dcset *s;
+  struct dentry *d;
+
+  for(s = dcache; s < dcache + NDCSET; s++){
+    acquire(&s->lock);
+    for(d = s->e; d < s->e + DCWAYS; d++){
+      if(d->dinum == inum && d->dev == dev)
+        d->dinum = 0;
+    }
+    release(&s->lock);
+  }
+}
+
+// Read the dirent at byte offset off of dp.
+static void
+dirread(struct inode *dp, uint off, void *de)
+{
+  if(readi(dp, 0, (uint64)de, off, sizeof(struct dirent)) != sizeof(struct dirent))
+    panic("dirread");
+}
+
+// Write the dirent at byte offset off of dp.
+static void
+dirwrite(struct inode *dp, uint off, void *de)
+{
+  if(writei(dp, 0, (uint64)de, off, sizeof(struct dirent)) != sizeof(struct dirent))
+    panic("dirwrite");
+}
+
+// The hash bucket of name in a hashed directory.
+static uint
+dirhash(char *name)
+{
+  uint h = 0;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % DHBUCKETS;
+}
+
+// Can the slot at offset off of a hashed directory
+// hold an entry, or is it a table or link slot?
+static int
+dhentry(uint off)
+{
+  uint slot = (off % BSIZE) / sizeof(struct dirent);
+
+  if(off < BSIZE)
+    return slot < 2 || slot >= 2 + DHSLOTS;
+  return slot != 0;
+}
+
+// First block of bucket b of hashed directory dp, or 0.
+static uint
+dhhead(struct inode *dp, uint b)
+{
+  struct dirhead h;
+
+  dirread(dp, (2 + b / DHPERSLOT) * sizeof(h), &h);
+  return h.head[b % DHPERSLOT];
+}
+
+// Block after blk in its bucket, or 0.
+static uint
+dhnext(struct inode *dp, uint blk)
+{
+  struct dirnext n;
+
+  dirread(dp, blk * BSIZE, &n);
+  return n.next;
+}
+
+// Find the entry for name in hashed directory dp.
+// Looks in block 0, then in name's bucket, so a lookup
+// reads a couple of blocks however big dp grows.
+// Return its byte offset, or -1.
+static int
+dhlookup(struct inode *dp, char *name, uint *pinum)
+{
+  uint off, blk;
+  struct dirent de;
+
+  if(dp->size == 0)
+    return -1;
+  for(off = 0; off < BSIZE; off += sizeof(de)){
+    if(!dhentry(off))
+      continue;
+    dirread(dp, off, &de);
+    if(de.inum != 0 && namecmp(name, de.name) == 0){
+      *pinum = de.inum;
+      return off;
+    }
+  }
+  for(blk = dhhead(dp, dirhash(name)); blk; blk = dhnext(dp, blk)){
+    for(off = blk * BSIZE + sizeof(de); off < (blk + 1) * BSIZE; off += sizeof(de)){
+      dirread(dp, off, &de);
+      if(de.inum != 0 && namecmp(name, de.name) == 0){
+        *pinum = de.inum;
+        return off;
+      }
+    }
+  }
+  return -1;
+}
+
+// Append a zeroed block to directory dp.
+// Return its block number within dp.
+static uint
+dhgrow(struct inode *dp)
+{
+  static char zeroes[BSIZE];
+  uint blk = dp->size / BSIZE;
+
+  if(writei(dp, 0, (uint64)zeroes, blk * BSIZE, BSIZE) != BSIZE)
+    panic("dhgrow");
+  return blk;
+}
+
+// Return the byte offset of a free slot for name in hashed
+// directory dp: in block 0 if it has room, else in name's
+// bucket, which gets a new block if all of its are full.
+static uint
+dhslot(struct inode *dp, char *name)
+{
+  uint off, blk, last, b;
+  struct dirent de;
+  struct dirhead h;
+  struct dirnext n;
+
+  if(dp->size == 0)
+    dhgrow(dp);
+  for(off = 0; off < BSIZE; off += sizeof(de)){
+    if(!dhentry(off))
+      continue;
+    dirread(dp, off, &de);
+    if(de.inum == 0)
+      return off;
+  }
+
+  b = dirhash(name);
+  last = 0;
+  for(blk = dhhead(dp, b); blk; last = blk, blk = dhnext(dp, blk)){
+    for(off = blk * BSIZE + sizeof(de); off < (blk + 1) * BSIZE; off += sizeof(de)){
+      dirread(dp, off, &de);
+      if(de.inum == 0)
+        return off;
+    }
+  }
+
+  // Every block of the bucket is full; link in a new one.
+  blk = dhgrow(dp);
+  if(last == 0){
+    off = (2 + b / DHPERSLOT) * sizeof(h);
+    dirread(dp, off, &h);
+    h.head[b % DHPERSLOT] = blk;
+    dirwrite(dp, off, &h);
+  } else {
+    dirread(dp, last * BSIZE, &n);
+    n.next = blk;
+    dirwrite(dp, last * BSIZE, &n);
+  }
+  return blk * BSIZE + sizeof(de);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
   uint off, inum;
+  int hoff;
   struct dirent de;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  if(dcache_lookup(dp, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
+  if(dp->major == DIRHASH){
+    if((hoff = dhlookup(dp, name, &inum)) < 0){
+      dcache_enter(dp, name, 0, 0);
+      return 0;
+    }
+    if(poff)
+      *poff = hoff;
+    dcache_enter(dp, name, inum, hoff);
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
+    dirread(dp, off, &de);
     if(de.inum == 0)
       continue;
     if(namecmp(name, de.name) == 0){
@@ -545,10 +1185,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp, name, inum, off);
       return iget(dp->dev, inum);
     }
   }
 
+  dcache_enter(dp, name, 0, 0);
   return 0;
 }
 
@@ -566,18 +1208,22 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(dp->major == DIRHASH){
+    off = dhslot(dp, name);
+  } else {
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      dirread(dp, off, &de);
+      if(de.inum == 0)
+        break;
+    }
   }
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcache_enter(dp, name, inum, off);
 
   return 0;
 }
@@ -24,9 +24,10 @@ struct superblock {
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +36,7 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -58,3 +59,34 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Dirents per block.
+#define DPB (BSIZE / sizeof(struct dirent))
+
+// Hashed directories.
+//
+// A directory whose dinode has major == DIRHASH is hashed.
+// Its block 0 is an ordinary array of dirents, except that
+// slots 2 .. 2+DHSLOTS-1 hold the first block of each of
+// DHBUCKETS hash buckets.  Once the rest of block 0 is full,
+// an entry goes in a block of its name's bucket; the first
+// slot of each such block links to the bucket's next block.
+// Table and link slots have inum 0, so code that reads a
+// directory as a flat array of dirents skips them.
+// Directories with major == 0 are plain arrays of dirents.
+#define DIRHASH 1
+#define DHSLOTS 8
+#define DHPERSLOT ((sizeof(struct dirent) - sizeof(ushort)) / sizeof(ushort))
+#define DHBUCKETS (DHSLOTS * DHPERSLOT)
+
+// Overlays a table slot in block 0.
+struct dirhead {
+  ushort inum;                // always 0
+  ushort head[DHPERSLOT];     // bucket's first block #, or 0
+};
+
+// Overlays the first slot of a bucket block.
+struct dirnext {
+  ushort inum;                // always 0
+  ushort next;                // bucket's next block #, or 0
+  char unused[DIRSIZ - sizeof(ushort)];
+};
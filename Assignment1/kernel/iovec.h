@@ -0,0 +1,7 @@
+// One buffer of a readv() or writev() call.
+struct iovec {
+  void *iov_base;   // Start of the buffer
+  uint64 iov_len;   // Its length in bytes
+};
+
+#define NIOV 16     // max buffers per readv()/writev()
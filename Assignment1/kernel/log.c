@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "logstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -14,12 +15,17 @@
 // no FS system calls active. Thus there is never
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
+// Every end_op() that finishes while others are still
+// outstanding joins the next commit, so concurrent
+// callers share one group commit.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// its start and end. Usually begin_op() just reserves
+// MAXOPBLOCKS log slots and returns.  But if it thinks the
+// log is close to running out, it sleeps until the last
+// outstanding end_op() commits.  A call that writes more,
+// such as a streaming file write, reserves what it needs
+// with begin_opn()/end_opn().
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -28,7 +34,18 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, but the blocks of one
+// append are written in parallel.
+//
+// A commit appends its blocks after those of earlier commits
+// and rewrites the header to cover them.  Installing the
+// blocks at their home locations is deferred until the log
+// is nearly full, and then done for all commits at once, so
+// most commits cost one log write and one header write.
+// There is no background installer: checkpoint() installs
+// synchronously, in whichever call finds the log full.
+// A block modified by several commits gets a log slot per
+// commit; recovery installs only the latest.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -37,19 +54,31 @@ struct logheader {
   int block[LOGSIZE];
 };
 
+// Log writes in flight at once.  Each holds a buffer,
+// on top of the LOGSIZE pinned in the cache.
+#define NBATCH 32
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // usable log slots: min(LOGSIZE, size-1).
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log slots reserved by outstanding calls.
   int committing;  // in commit(), please wait.
+  int committed;   // lh.block[0..committed) are on disk.
   int dev;
   struct logheader lh;
+  struct buf *batch[NBATCH]; // commit()'s in-flight writes.
+  struct logstat stat;
+  int nfreed;                // blocks freed since the last commit,
+  uchar freed[FSSIZE/8+1];   // as a bitmap.
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void checkpoint();
 
 void
 initlog(int dev, struct superblock *sb)
@@ -60,26 +89,63 @@ initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  log.cap = LOGSIZE;
+  if(log.cap > log.size - 1)
+    log.cap = log.size - 1;
   log.dev = dev;
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Is log slot tail overwritten by a later slot for the same block?
+static int
+superseded(int tail)
+{
+  int i;
+
+  for (i = tail + 1; i < log.lh.n; i++) {
+    if (log.lh.block[i] == log.lh.block[tail])
+      return 1;
+  }
+  return 0;
+}
+
+// Wait for the first n writes in log.batch to finish.
+static void
+finish_batch(int n, int unpin)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    bwait(log.batch[i]);
+    if(unpin)
+      bunpin(log.batch[i]);
+    brelse(log.batch[i]);
+  }
+}
+
+// Copy committed blocks from log to their home location.
+// Up to NBATCH writes are queued before waiting for any,
+// so the disk sees many of them at once.
 static void
 install_trans(int recovering)
 {
-  int tail;
+  int tail, n = 0;
 
   for (tail = 0; tail < log.lh.n; tail++) {
+    if (superseded(tail))
+      continue;
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
+    bwrite_async(dbuf);  // queue write of dst
     brelse(lbuf);
-    brelse(dbuf);
+    log.batch[n++] = dbuf;
+    if (n == NBATCH) {
+      finish_batch(n, recovering == 0);
+      n = 0;
+    }
   }
+  finish_batch(n, recovering == 0);
 }
 
 // Read the log header from disk into the in-memory log header
@@ -119,37 +185,61 @@ recover_from_log(void)
   read_head();
   install_trans(1); // if committed, copy from log to disk
   log.lh.n = 0;
+  log.committed = 0;
   write_head(); // clear the log
 }
 
-// called at the start of each FS system call.
+// called at the start of each FS system call that
+// writes at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  if(n > log.cap)
+    panic("begin_opn: too many blocks");
+
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
-      // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+    } else if(log.lh.n + log.reserved + n > log.cap){
+      if(log.outstanding > 0){
+        // this op might exhaust log space; wait for commit.
+        sleep(&log, &log.lock);
+        continue;
+      }
+      // no commit is coming to make room; empty the log.
+      log.committing = 1;
+      release(&log.lock);
+      checkpoint();
+      acquire(&log.lock);
+      log.committing = 0;
+      wakeup(&log);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call, with
+// the n passed to begin_opn().
 // commits if this was the last outstanding operation.
 void
-end_op(void)
+end_opn(int n)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= n;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -157,7 +247,7 @@ end_op(void)
     log.committing = 1;
   } else {
     // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
+    // and decrementing log.reserved has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
@@ -174,37 +264,120 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+void
+end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// Copy blocks modified since the last commit from cache
+// to log.  The log slots are adjacent, so the queued writes
+// merge into a few large disk requests.
 static void
 write_log(void)
 {
-  int tail;
+  int tail, n = 0;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+  for (tail = log.committed; tail < log.lh.n; tail++) {
+    struct buf *to = bnew(log.dev, log.start+tail+1); // log block, all overwritten
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    bwrite_async(to);  // queue write of the log
     brelse(from);
-    brelse(to);
+    log.batch[n++] = to;
+    if (n == NBATCH) {
+      finish_batch(n, 0);
+      n = 0;
+    }
   }
+  finish_batch(n, 0);
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0) {
+  if (log.lh.n > log.committed) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    acquire(&log.lock);
+    log.stat.commits++;
+    log.stat.blocks += log.lh.n - log.committed;
+    release(&log.lock);
+    log.committed = log.lh.n;
+  }
+  if (log.nfreed > 0) {
+    // the frees are on disk; their blocks may be reused.
+    memset(log.freed, 0, sizeof(log.freed));
+    log.nfreed = 0;
   }
+  if (log.lh.n + MAXOPBLOCKS > log.cap)
+    checkpoint();   // The next op might not fit
+}
+
+// Install all committed transactions and empty the log.
+static void
+checkpoint()
+{
+  if (log.lh.n == 0)
+    return;
+  install_trans(0); // Now install writes to home locations
+  log.lh.n = 0;
+  log.committed = 0;
+  write_head();    // Erase the transactions from the log
+  acquire(&log.lock);
+  log.stat.installs++;
+  release(&log.lock);
+}
+
+// Copy the log's throughput counters into *st.
+void
+logstat(struct logstat *st)
+{
+  acquire(&log.lock);
+  *st = log.stat;
+  release(&log.lock);
+}
+
+// Record that block b was freed by the current transaction.
+// Until that commits, b still belongs to its old owner on
+// disk, so it must not be written outside the log.
+void
+log_free(uint b)
+{
+  if (b >= FSSIZE)
+    panic("log_free");
+  acquire(&log.lock);
+  if ((log.freed[b/8] & (1 << (b%8))) == 0) {
+    log.freed[b/8] |= 1 << (b%8);
+    log.nfreed++;
+  }
+  release(&log.lock);
+}
+
+// May block b need the log?  True if the log holds a copy of
+// b that installing would write over b's home location, or
+// if b was freed since the last commit.  A caller that gets
+// 0 may write b in place.
+int
+log_busy(uint b)
+{
+  int i, busy = 0;
+
+  acquire(&log.lock);
+  if (b < FSSIZE && (log.freed[b/8] & (1 << (b%8))))
+    busy = 1;
+  for (i = 0; !busy && i < log.lh.n; i++) {
+    if (log.lh.block[i] == b)
+      busy = 1;
+  }
+  release(&log.lock);
+  return busy;
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// commit()/write_log() will do the disk write, and
+// install_trans() unpins it once it is at its home location.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -216,19 +389,27 @@ log_write(struct buf *b)
 {
   int i;
 
+  int pinned = 0;
+
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
   for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
-      break;
+    if (log.lh.block[i] == b->blockno) {
+      if (i >= log.committed)   // log absorption
+        break;
+      // logged by an earlier commit; already pinned, but
+      // its committed slot must not be overwritten.
+      pinned = 1;
+    }
   }
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
-    bpin(b);
+    if (!pinned)
+      bpin(b);
     log.lh.n++;
   }
   release(&log.lock);
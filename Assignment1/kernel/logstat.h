@@ -0,0 +1,5 @@
+struct logstat {
+  uint64 commits;   // Transactions written to the log
+  uint64 blocks;    // Blocks written to the log by those commits
+  uint64 installs;  // Times the log was installed and emptied
+};
@@ -29,6 +29,7 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    traceinit();     // /dev/trace
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     barrinit();
@@ -1,15 +1,21 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC        64  // default maximum number of processes
+#define NPROCMAX   4096  // limit for setmaxproc()
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE      500  // maximum number of cached i-nodes
+#define NIBUCKET     61  // inode cache hash chains (prime)
+#define NDENTRY    1024  // directory name lookup cache entries
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define NSTREAM      32  // max blocks per streaming filewrite op
+#define LOGSIZE      120   // max data blocks in on-disk log (<= 127, < NBUF/2)
+#define NBUF         256   // size of disk block cache
+#define NBUCKET      61    // buffer cache hash chains (prime)
+#define NREADAHEAD    4    // blocks read ahead of sequential readi
+#define FSSIZE       10000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 // #define TIMER_INTERVAL 10000000
 #define TIMER_INTERVAL 100000
@@ -7,22 +7,46 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "iovec.h"
 
-#define PIPESIZE 512
+// The ring buffer is made of whole pages, so reads and
+// writes copy contiguous runs of bytes at a time.
+// nread and nwrite run freely and wrap at 2^32, so
+// PIPESIZE must divide 2^32: PIPEPAGES a power of two.
+#define PIPEPAGES 1
+#define PIPESIZE (PIPEPAGES*PGSIZE)
+
+#if PIPEPAGES <= 0 || (PIPEPAGES & (PIPEPAGES-1)) != 0
+#error "PIPEPAGES must be a power of two"
+#endif
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rsplice;    // a splice owns the read side
+  int wsplice;    // a splice owns the write side
 };
 
+static void
+pipefree(struct pipe *pi)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(pi->page[i])
+      kfree(pi->page[i]);
+  kfree((char*)pi);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *pi;
+  int i;
 
   pi = 0;
   *f0 = *f1 = 0;
@@ -30,10 +54,17 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  for(i = 0; i < PIPEPAGES; i++)
+    pi->page[i] = 0;
+  for(i = 0; i < PIPEPAGES; i++)
+    if((pi->page[i] = kalloc()) == 0)
+      goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->rsplice = 0;
+  pi->wsplice = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -47,7 +78,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,63 +99,225 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
 
+// Return the address of ring position pos, and in *m
+// the number of bytes from there to the end of its page.
+static char*
+ringaddr(struct pipe *pi, uint pos, uint *m)
+{
+  uint o = pos % PIPESIZE;
+
+  *m = PGSIZE - o % PGSIZE;
+  return pi->page[o / PGSIZE] + o % PGSIZE;
+}
+
+// Readers sleep only while the pipe is empty and writers
+// only while it is full, so wakeups are needed only when a
+// write makes an empty pipe non-empty or a read makes a
+// full pipe non-full.
+// Write the niov user buffers in iov to the pipe, in order.
+int
+pipewritev(struct pipe *pi, struct iovec *iov, int niov)
+{
+  int i = 0, j, k, n, wake = 0;
+  uint m, space;
+  uint64 addr;
+  char *dst;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  for(k = 0; k < niov; k++){
+    addr = (uint64)iov[k].iov_base;
+    n = iov[k].iov_len;
+    for(j = 0; j < n; ){
+      if(pi->readopen == 0 || pr->killed){
+        if(wake)
+          wakeup(&pi->nread);
+        release(&pi->lock);
+        return -1;
+      }
+      if(pi->nwrite == pi->nread + PIPESIZE || pi->wsplice){ //DOC: pipewrite-full
+        if(wake)
+          wakeup(&pi->nread);
+        wake = 0;
+        sleep(&pi->nwrite, &pi->lock);
+      } else {
+        space = pi->nread + PIPESIZE - pi->nwrite;
+        dst = ringaddr(pi, pi->nwrite, &m);
+        if(m > space)
+          m = space;
+        if(m > n - j)
+          m = n - j;
+        if(copyin(pr->pagetable, dst, addr + j, m) == -1)
+          goto out;
+        if(pi->nwrite == pi->nread)
+          wake = 1;
+        pi->nwrite += m;
+        i += m;
+        j += m;
+      }
+    }
+  }
+out:
+  if(wake)
+    wakeup(&pi->nread);
+  release(&pi->lock);
+
+  return i;
+}
+
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return pipewritev(pi, &iov, 1);
+}
+
+// Read into the niov user buffers in iov, in order, as much
+// as the pipe holds; wait only if it is empty.
+int
+pipereadv(struct pipe *pi, struct iovec *iov, int niov)
+{
+  int i = 0, j, k, n;
+  uint m, avail;
+  uint64 addr;
+  char *src;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  while(i < n){
-    if(pi->readopen == 0 || pr->killed){
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rsplice){  //DOC: pipe-empty
+    if(pr->killed){
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
-      wakeup(&pi->nread);
-      sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+  }
+  if(pi->nwrite == pi->nread + PIPESIZE)
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  for(k = 0; k < niov; k++){
+    addr = (uint64)iov[k].iov_base;
+    n = iov[k].iov_len;
+    for(j = 0; j < n; j += m){  //DOC: piperead-copy
+      avail = pi->nwrite - pi->nread;
+      if(avail == 0)
+        goto out;
+      src = ringaddr(pi, pi->nread, &m);
+      if(m > avail)
+        m = avail;
+      if(m > n - j)
+        m = n - j;
+      if(copyout(pr->pagetable, addr + j, src, m) == -1)
+        goto out;
+      pi->nread += m;
+      i += m;
     }
   }
-  wakeup(&pi->nread);
+out:
   release(&pi->lock);
-
   return i;
 }
 
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  struct iovec iov;
+
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return pipereadv(pi, &iov, 1);
+}
+
+// splice() moves data between a pipe and a file by having
+// readi() or writei() copy straight to or from the ring.
+// pipespliced() and pipesplicew() claim the read or write
+// side, so the claimed bytes can be copied without holding
+// pi->lock, and return the address and length of the
+// longest contiguous run available, at most n bytes.
+// pipesplicedone() gives the side back, with the number
+// of bytes actually copied.
+
+// Claim up to n bytes of data to read.
+// Returns 0 at end of file, -1 if killed.
+int
+pipespliced(struct pipe *pi, char **src, int n)
+{
+  uint m, avail;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rsplice){
     if(pr->killed){
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    sleep(&pi->nread, &pi->lock);
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  avail = pi->nwrite - pi->nread;
+  *src = ringaddr(pi, pi->nread, &m);
+  if(m > avail)
+    m = avail;
+  if(m > n)
+    m = n;
+  if(m > 0)
+    pi->rsplice = 1;
+  release(&pi->lock);
+  return m;
+}
+
+// Claim up to n bytes of free space to write.
+// Returns -1 if the read side is closed or if killed.
+int
+pipesplicew(struct pipe *pi, char **dst, int n)
+{
+  uint m, space;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(1){
+    if(pi->readopen == 0 || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(pi->nwrite != pi->nread + PIPESIZE && !pi->wsplice)
       break;
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  space = pi->nread + PIPESIZE - pi->nwrite;
+  *dst = ringaddr(pi, pi->nwrite, &m);
+  if(m > space)
+    m = space;
+  if(m > n)
+    m = n;
+  pi->wsplice = 1;
+  release(&pi->lock);
+  return m;
+}
+
+// Release the side claimed by pipespliced() (write == 0) or
+// pipesplicew() (write == 1), after copying m bytes.
+void
+pipesplicedone(struct pipe *pi, int write, int m)
+{
+  acquire(&pi->lock);
+  if(write){
+    if(m > 0 && pi->nwrite == pi->nread)
+      wakeup(&pi->nread);
+    pi->nwrite += m;
+    pi->wsplice = 0;
+    wakeup(&pi->nwrite);  // other writers may wait for the claim
+  } else {
+    if(m > 0 && pi->nwrite == pi->nread + PIPESIZE)
+      wakeup(&pi->nwrite);
+    pi->nread += m;
+    pi->rsplice = 0;
+    wakeup(&pi->nread);   // other readers may wait for the claim
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
-  return i;
 }
@@ -17,14 +17,51 @@
 
 volatile int panicked = 0;
 
-// lock to avoid interleaving concurrent printf's.
+// printf() formats a message into this CPU's staging buffer,
+// with interrupts off, and then queues all of it on the UART's
+// transmit buffer at once.  So concurrent printf()s neither
+// interleave nor wait for each other or for the serial line.
+// Before printfinit() and after a panic, printf() writes
+// each character synchronously instead.
 static struct {
-  struct spinlock lock;
-  int locking;
+  int async;
 } pr;
 
+#define PRSTAGE 256
+static struct stage {
+  char buf[PRSTAGE];
+  int n;
+} stage[NCPU];
+
 static char digits[] = "0123456789abcdef";
 
+// Queue this CPU's staged output.
+// Interrupts must be disabled.
+static void
+prflush(void)
+{
+  struct stage *st = &stage[cpuid()];
+
+  if(st->n > 0)
+    uartwrite_async(st->buf, st->n);
+  st->n = 0;
+}
+
+static void
+prputc(int c)
+{
+  struct stage *st;
+
+  if(!pr.async){
+    consputc(c);
+    return;
+  }
+  st = &stage[cpuid()];
+  st->buf[st->n++] = c;
+  if(st->n == PRSTAGE)
+    prflush();
+}
+
 static void
 printint(int xx, int base, int sign)
 {
@@ -46,17 +83,17 @@ printint(int xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    prputc(buf[i]);
 }
 
 static void
 printptr(uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  prputc('0');
+  prputc('x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    prputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console. only understands %d, %x, %p, %s.
@@ -64,12 +101,10 @@ void
 printf(char *fmt, ...)
 {
   va_list ap;
-  int i, c, locking;
+  int i, c;
   char *s;
 
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);
+  push_off();  // stay on this CPU's staging buffer
 
   if (fmt == 0)
     panic("null fmt");
@@ -77,7 +112,7 @@ printf(char *fmt, ...)
   va_start(ap, fmt);
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
-      consputc(c);
+      prputc(c);
       continue;
     }
     c = fmt[++i] & 0xff;
@@ -97,27 +132,29 @@ printf(char *fmt, ...)
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        prputc(*s);
       break;
     case '%':
-      consputc('%');
+      prputc('%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      prputc('%');
+      prputc(c);
       break;
     }
   }
 
-  if(locking)
-    release(&pr.lock);
+  if(pr.async)
+    prflush();
+  pop_off();
 }
 
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  pr.async = 0;
+  uartflush_sync();  // earlier messages first
   printf("panic: ");
   printf(s);
   printf("\n");
@@ -129,6 +166,5 @@ panic(char *s)
 void
 printfinit(void)
 {
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
+  pr.async = 1;
 }
@@ -6,21 +6,42 @@
 #include "proc.h"
 #include "defs.h"
 #include "procstat.h"
+#include "cpustat.h"
+#include "batchstat.h"
 #include "sleeplock.h"
 #include "buffer.h"
 #include "barr.h"
 #include "sem_buffer.h" 
+#include "trace.h"
 
 int sched_policy;
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Process descriptors are carved from whole pages as they are
+// needed and are never freed, so a struct proc pointer stays
+// valid even after its process exits.  Each is on the allproc
+// list, which only grows and can be walked without a lock,
+// and an unused one is on the free list.  A descriptor gets its
+// kernel stack the first time it is used and keeps it.
+struct proc *allproc;
+static struct proc *alltail;
+static struct proc *freeprocs;
+static int nslots;          // descriptors created
+static int nprocs;          // descriptors in use
+static int maxproc = NPROC; // limit on nprocs
+struct spinlock proc_lock;  // protects the above
+static int stackgen;        // kernel stacks mapped so far
 
 struct proc *initproc;
 
 int nextpid = 1;
-struct spinlock pid_lock;
+struct spinlock pid_lock;   // protects nextpid and pidhash
+
+// Live processes by pid, so kill() and friends need not
+// scan the table.
+#define NPIDHASH 61
+static struct proc *pidhash[NPIDHASH];
 struct sleeplock dummy;
 
 extern void forkret(void);
@@ -45,43 +66,121 @@ static int cpubursts_est_max = 0;
 static int cpubursts_est_min = 0x7FFFFFFF;
 static int estimation_error = 0;
 static int estimation_error_instance = 0;
+static struct batchstat lastbatch;
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
+// Each process keeps its children on a list in p->kids,
+// with the zombies at the front, so wait() finds one to reap
+// without scanning the table.  p->kidlock protects the list
+// and the parent field of each child; it helps ensure that
+// wakeups of wait()ing parents are not lost, and must be
+// acquired before any p->lock.  A process that holds its
+// own kidlock may also acquire initproc's, to reparent.
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// initialize the proc table at boot time.
 void
-proc_mapstacks(pagetable_t kpgtbl) {
+procinit(void)
+{
+  initlock(&pid_lock, "nextpid");
+  initlock(&proc_lock, "proc_lock");
+}
+
+// Carve a page into process descriptors and put them
+// on the free list.  Caller must hold proc_lock.
+// Returns -1 if out of memory or descriptors.
+static int
+procslab(void)
+{
+  char *page;
   struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  int off;
+
+  if(nslots >= NPROCMAX || (page = kalloc()) == 0)
+    return -1;
+  memset(page, 0, PGSIZE);
+  for(off = 0; off + sizeof(struct proc) <= PGSIZE && nslots < NPROCMAX;
+      off += sizeof(struct proc)){
+    p = (struct proc*)(page + off);
+    initlock(&p->lock, "proc");
+    initlock(&p->kidlock, "kids");
+    p->state = UNUSED;
+    p->slot = nslots++;
+    p->freenext = freeprocs;
+    freeprocs = p;
+
+    // let lock-free walkers of allproc see p only once
+    // it is initialized.
+    __sync_synchronize();
+    if(alltail)
+      alltail->allnext = p;
+    else
+      allproc = p;
+    alltail = p;
   }
+  return 0;
 }
 
-// initialize the proc table at boot time.
-void
-procinit(void)
+// Take a descriptor off the free list, with a kernel stack.
+// The stack is mapped high in memory, below an invalid
+// guard page.  Returns 0 if maxproc processes exist or
+// memory is short.
+static struct proc*
+procget(void)
 {
-  struct proc *p;
-  
-  initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
+  struct proc *p = 0;
+  char *pa;
+
+  acquire(&proc_lock);
+  if(nprocs >= maxproc || (freeprocs == 0 && procslab() < 0))
+    goto out;
+  p = freeprocs;
+  if(p->kstack == 0){
+    if((pa = kalloc()) == 0){
+      p = 0;
+      goto out;
+    }
+    if(kvmmapstack(KSTACK(p->slot), (uint64)pa) < 0){
+      kfree(pa);
+      p = 0;
+      goto out;
+    }
+    p->kstack = KSTACK(p->slot);
+    __sync_synchronize();
+    stackgen++;  // runproc() flushes before switching to it
   }
+  freeprocs = p->freenext;
+  nprocs++;
+out:
+  release(&proc_lock);
+  return p;
+}
+
+// Put p back on the free list.
+static void
+procput(struct proc *p)
+{
+  acquire(&proc_lock);
+  p->freenext = freeprocs;
+  freeprocs = p;
+  nprocs--;
+  release(&proc_lock);
+}
+
+// Set the maximum number of processes to n,
+// and return the old maximum, or -1 if n is out of range.
+int
+setmaxproc(int n)
+{
+  int old;
+
+  if(n < 1 || n > NPROCMAX)
+    return -1;
+  acquire(&proc_lock);
+  old = maxproc;
+  maxproc = n;
+  release(&proc_lock);
+  return old;
 }
 
 // Must be called with interrupts disabled,
@@ -113,19 +212,130 @@ myproc(void) {
   return p;
 }
 
-int
-allocpid() {
-  int pid;
-  
+// Give p a new pid and enter it in pidhash.
+// p->lock must be held.
+static void
+allocpid(struct proc *p) {
+  struct proc **pp;
+
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  pp = &pidhash[p->pid % NPIDHASH];
+  p->pidnext = *pp;
+  *pp = p;
+  release(&pid_lock);
+}
+
+// Remove p from pidhash.
+// p->lock must be held.
+static void
+freepid(struct proc *p) {
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+}
+
+// Return the process with the given pid, or 0, without
+// locking it; the caller must lock it and check p->pid,
+// since it may exit and be reused in the meantime.
+static struct proc*
+pidfind(int pid) {
+  struct proc *p;
+
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
   release(&pid_lock);
+  return p;
+}
+
+// Add np to pp's kids list, at the front if it is a zombie.
+// Caller must hold pp->kidlock.
+static void
+kidinsert(struct proc *pp, struct proc *np)
+{
+  struct proc *head = pp->kids;
+
+  if(head == 0){
+    np->knext = np->kprev = np;
+    pp->kids = np;
+    return;
+  }
+  np->knext = head;
+  np->kprev = head->kprev;
+  head->kprev->knext = np;
+  head->kprev = np;
+  if(np->state == ZOMBIE)
+    pp->kids = np;
+}
+
+// Remove np from pp's kids list.
+// Caller must hold pp->kidlock.
+static void
+kidremove(struct proc *pp, struct proc *np)
+{
+  if(np->knext == np){
+    pp->kids = 0;
+  } else {
+    np->kprev->knext = np->knext;
+    np->knext->kprev = np->kprev;
+    if(pp->kids == np)
+      pp->kids = np->knext;
+  }
+  np->knext = np->kprev = 0;
+}
+
+// Lock and return p's parent, which may change under
+// us while its own parent reparents p to init.
+static struct proc*
+lockparent(struct proc *p)
+{
+  struct proc *pp;
+
+  for(;;){
+    if((pp = p->parent) == 0)
+      return 0;
+    acquire(&pp->kidlock);
+    if(p->parent == pp)
+      return pp;
+    release(&pp->kidlock);
+  }
+}
+
+// Return the pid of p's parent, or -1.
+static int
+parentpid(struct proc *p)
+{
+  struct proc *pp;
+  int pid;
 
+  if((pp = lockparent(p)) == 0)
+    return -1;
+  pid = pp->pid;
+  release(&pp->kidlock);
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// Make p the parent of np.
+static void
+setparent(struct proc *p, struct proc *np)
+{
+  acquire(&p->kidlock);
+  np->parent = p;
+  kidinsert(p, np);
+  release(&p->kidlock);
+}
+
+// Take an UNUSED proc from the free list.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -135,18 +345,11 @@ allocproc(void)
   struct proc *p;
   uint xticks;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  if((p = procget()) == 0)
+    return 0;
+  acquire(&p->lock);
 
-found:
-  p->pid = allocpid();
+  allocpid(p);
   p->state = USED;
 
   // Allocate a trapframe page.
@@ -180,6 +383,9 @@ found:
 
   p->is_batchproc = 0;
   p->cpu_usage = 0;
+  p->syncverbose = 1;
+  p->utime = 0;
+  p->ktime = 0;
 
   return p;
 }
@@ -197,6 +403,8 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  if(p->pid)
+    freepid(p);
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -204,6 +412,7 @@ freeproc(struct proc *p)
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+  procput(p);
 }
 
 // Create a user page table for a given process,
@@ -342,14 +551,13 @@ fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->syncverbose = p->syncverbose;
 
   pid = np->pid;
 
   release(&np->lock);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  setparent(p, np);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -393,14 +601,13 @@ forkf(uint64 faddr)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->syncverbose = p->syncverbose;
 
   pid = np->pid;
 
   release(&np->lock);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  setparent(p, np);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -444,6 +651,7 @@ forkp(int priority)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->syncverbose = p->syncverbose;
 
   pid = np->pid;
 
@@ -458,9 +666,7 @@ forkp(int priority)
   batchsize++;
   batchsize2++;
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  setparent(p, np);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -470,19 +676,40 @@ forkp(int priority)
   return pid;
 }
 
+// Wake p if it is sleeping in wait().
+// Must be called without any p->lock.
+static void
+wakeparent(struct proc *p)
+{
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == p){
+    p->state = RUNNABLE;
+    trace(TR_WAKEUP, p->pid, (uint64)p, 0);
+  }
+  release(&p->lock);
+}
+
 // Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Caller must hold p->kidlock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
-
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  struct proc *np;
+  int zombies = 0;
+
+  if(p->kids == 0)
+    return;
+  acquire(&initproc->kidlock);
+  while((np = p->kids) != 0){
+    kidremove(p, np);
+    np->parent = initproc;
+    kidinsert(initproc, np);
+    if(np->state == ZOMBIE)
+      zombies = 1;
   }
+  release(&initproc->kidlock);
+  if(zombies)
+    wakeparent(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -492,6 +719,7 @@ void
 exit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
   uint xticks;
 
   if(p == initproc)
@@ -511,21 +739,13 @@ exit(int status)
   end_op();
   p->cwd = 0;
 
-  acquire(&wait_lock);
-
   // Give any children to init.
+  acquire(&p->kidlock);
   reparent(p);
+  release(&p->kidlock);
 
-  // Parent might be sleeping in wait().
-  wakeup(p->parent);
-  
-  acquire(&p->lock);
-
-  p->xstate = status;
-  p->state = ZOMBIE;
-
-  release(&wait_lock);
-
+  // Account for the batch before taking any locks, since
+  // the summary is printed when the last one exits.
   acquire(&tickslock);
   xticks = ticks;
   release(&tickslock);
@@ -569,6 +789,17 @@ exit(int status)
 	   printf("CPU burst estimates: count: %d, avg: %d, max: %d, min: %d\n", num_cpubursts_est, cpubursts_est_tot/num_cpubursts_est, cpubursts_est_max, cpubursts_est_min);
 	   printf("CPU burst estimation error: count: %d, avg: %d\n", estimation_error_instance, estimation_error/estimation_error_instance);
 	}
+	lastbatch.seq++;
+	lastbatch.policy = sched_policy;
+	lastbatch.nproc = batchsize2;
+	lastbatch.exectime = p->endtime - batch_start;
+	lastbatch.turnaround = turnaround;
+	lastbatch.waiting = waiting_tot;
+	lastbatch.completion = completion_tot;
+	lastbatch.nbursts = num_cpubursts;
+	lastbatch.bursts = cpubursts_tot;
+	lastbatch.nerrors = estimation_error_instance;
+	lastbatch.error = estimation_error;
 	batchsize2 = 0;
 	batch_start = 0x7FFFFFFF;
 	turnaround = 0;
@@ -589,57 +820,77 @@ exit(int status)
      }
   }
 
+  pp = lockparent(p);
+
+  // Parent might be sleeping in wait().
+  wakeparent(pp);
+
+  acquire(&p->lock);
+
+  p->xstate = status;
+  p->state = ZOMBIE;
+
+  // Move to the front of the parent's list, with the zombies.
+  kidremove(pp, p);
+  kidinsert(pp, p);
+
+  release(&pp->kidlock);
+
   // Jump into the scheduler, never to return.
   sched();
   panic("zombie exit");
 }
 
+// Reap zombie child np of p, copying its exit status to addr.
+// Caller must hold p->kidlock.
+// Returns np's pid, or -1 if the copy fails.
+static int
+reap(struct proc *p, struct proc *np, uint64 addr)
+{
+  int pid;
+
+  // make sure the child isn't still in exit() or swtch().
+  acquire(&np->lock);
+  pid = np->pid;
+  if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                          sizeof(np->xstate)) < 0) {
+    release(&np->lock);
+    return -1;
+  }
+  kidremove(p, np);
+  freeproc(np);
+  release(&np->lock);
+  return pid;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  acquire(&p->kidlock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
-        release(&np->lock);
-      }
+    // Zombies are at the front of the list.
+    np = p->kids;
+    if(np && np->state == ZOMBIE){
+      pid = reap(p, np, addr);
+      release(&p->kidlock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
-      release(&wait_lock);
+    if(np == 0 || p->killed){
+      release(&p->kidlock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->kidlock);  //DOC: wait-sleep
   }
 }
 
@@ -648,44 +899,62 @@ waitpid(int pid, uint64 addr)
 {
   struct proc *np;
   struct proc *p = myproc();
-  int found=0;
 
-  acquire(&wait_lock);
+  acquire(&p->kidlock);
 
   for(;;){
-    // Scan through table looking for child with pid
-    for(np = proc; np < &proc[NPROC]; np++){
-      if((np->parent == p) && (np->pid == pid)){
-	found = 1;
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        if(np->state == ZOMBIE){
-           if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-             release(&np->lock);
-             release(&wait_lock);
-             return -1;
-           }
-           freeproc(np);
-           release(&np->lock);
-           release(&wait_lock);
-           return pid;
-	}
+    // Only p can free its children, and their pids and parent
+    // fields cannot change while it holds p->kidlock.
+    np = pidfind(pid);
 
-        release(&np->lock);
-      }
+    // No point waiting if we don't have such a child.
+    if(np == 0 || np->parent != p || np->pid != pid || p->killed){
+      release(&p->kidlock);
+      return -1;
     }
 
-    // No point waiting if we don't have any children.
-    if(!found || p->killed){
-      release(&wait_lock);
-      return -1;
+    if(np->state == ZOMBIE){
+      pid = reap(p, np, addr);
+      release(&p->kidlock);
+      return pid;
     }
 
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->kidlock);  //DOC: wait-sleep
+  }
+}
+
+// Switch to p, which the caller has chosen and locked, and
+// return when it gives up the CPU.  It is the process's job
+// to release its lock and then reacquire it before jumping
+// back to us.  Time spent away from the scheduler is charged
+// to c as busy.
+static void
+runproc(struct cpu *c, struct proc *p, uint xticks)
+{
+  uint64 t0;
+
+  p->state = RUNNING;
+  p->waittime += (xticks - p->waitstart);
+  p->burst_start = xticks;
+  c->proc = p;
+  trace(TR_SWITCH, p->pid, sched_policy, xticks);
+
+  // p's stack may have been mapped by another CPU since
+  // this one last flushed, and be in the TLB as invalid.
+  if(c->stackgen != stackgen){
+    c->stackgen = stackgen;
+    sfence_vma();
   }
+  t0 = r_time();
+  swtch(&c->context, &p->context);
+  c->busy += r_time() - t0;
+  c->nswitch++;
+  trace(TR_SWITCHOUT, p->pid, p->state, 0);
+
+  // Process is done running for now.
+  // It should have changed its p->state before coming back.
+  c->proc = 0;
 }
 
 // Per-CPU process scheduler.
@@ -715,7 +984,7 @@ scheduler(void)
        xticks = ticks;
        release(&tickslock);
        q = 0;
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->allnext) {
           acquire(&p->lock);
 	  if(p->state == RUNNABLE) {
 	     if (!p->is_batchproc) {
@@ -733,15 +1002,7 @@ scheduler(void)
 	  else release(&p->lock);
        }
        if (q) {
-          q->state = RUNNING;
-          q->waittime += (xticks - q->waitstart);
-          q->burst_start = xticks;
-          c->proc = q;
-          swtch(&c->context, &q->context);
-
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
+          runproc(c, q, xticks);
 	  release(&q->lock);
        }
     }
@@ -750,7 +1011,7 @@ scheduler(void)
        acquire(&tickslock);
        xticks = ticks;
        release(&tickslock);
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->allnext) {
           acquire(&p->lock);
 	  if(p->state == RUNNABLE) {
 	     p->cpu_usage = p->cpu_usage/2;
@@ -759,7 +1020,7 @@ scheduler(void)
 	  release(&p->lock);
        }
        q = 0;
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->allnext) {
           acquire(&p->lock);
           if(p->state == RUNNABLE) {
              if (!p->is_batchproc) {
@@ -777,38 +1038,19 @@ scheduler(void)
           else release(&p->lock);
        }
        if (q) {
-          q->state = RUNNING;
-          q->waittime += (xticks - q->waitstart);
-          q->burst_start = xticks;
-          c->proc = q;
-          swtch(&c->context, &q->context);
-
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
+          runproc(c, q, xticks);
           release(&q->lock);
        }
     }
     else {
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->allnext) {
           if ((sched_policy != SCHED_NPREEMPT_FCFS) && (sched_policy != SCHED_PREEMPT_RR)) break;
           acquire(&tickslock);
           xticks = ticks;
           release(&tickslock);
           acquire(&p->lock);
           if(p->state == RUNNABLE) {
-            // Switch to chosen process.  It is the process's job
-            // to release its lock and then reacquire it
-            // before jumping back to us.
-            p->state = RUNNING;
-	    p->waittime += (xticks - p->waitstart);
-	    p->burst_start = xticks;
-            c->proc = p;
-            swtch(&c->context, &p->context);
-
-            // Process is done running for now.
-            // It should have changed its p->state before coming back.
-            c->proc = 0;
+            runproc(c, p, xticks);
           }
           release(&p->lock);
        }
@@ -816,6 +1058,22 @@ scheduler(void)
   }
 }
 
+// Charge the time CSR counts since p->tstamp to user mode
+// if user is set, else to kernel mode. Called at every mode
+// boundary: usertrap, usertrapret, and around swtch in sched.
+// Only the process itself updates these, so no lock is needed.
+void
+chargetime(struct proc *p, int user)
+{
+  uint64 now = r_time();
+
+  if(user)
+    p->utime += now - p->tstamp;
+  else
+    p->ktime += now - p->tstamp;
+  p->tstamp = now;
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -839,7 +1097,9 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  chargetime(p, 0);
   swtch(&p->context, &mycpu()->context);
+  p->tstamp = r_time();
   mycpu()->intena = intena;
 }
 
@@ -888,6 +1148,7 @@ forkret(void)
   uint xticks;
 
   // Still holding p->lock from scheduler.
+  myproc()->tstamp = r_time();
   release(&myproc()->lock);
 
   acquire(&tickslock);
@@ -935,6 +1196,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  trace(TR_SLEEP, p->pid, (uint64)chan, 0);
 
   p->cpu_usage += (SCHED_PARAM_CPU_USAGE/2);
 
@@ -1002,11 +1264,12 @@ wakeup(void *chan)
   // }
   // else xticks = ticks;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = allproc; p; p = p->allnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
         p->state = RUNNABLE;
+        trace(TR_WAKEUP, p->pid, (uint64)chan, 0);
 	// p->waitstart = xticks;
       }
       release(&p->lock);
@@ -1026,11 +1289,12 @@ void wakeupone(void *chan)
   // }
   // else xticks = ticks;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = allproc; p; p = p->allnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
         p->state = RUNNABLE;
+        trace(TR_WAKEUP, p->pid, (uint64)chan, 0);
 	      // p->waitstart = xticks;
         release(&p->lock);
         return;
@@ -1053,20 +1317,20 @@ kill(int pid)
   xticks = ticks;
   release(&tickslock);
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-	p->waitstart = xticks;
-      }
-      release(&p->lock);
-      return 0;
+  if((p = pidfind(pid)) == 0)
+    return -1;
+  acquire(&p->lock);
+  if(p->pid == pid){
+    p->killed = 1;
+    if(p->state == SLEEPING){
+      // Wake process from sleep().
+      p->state = RUNNABLE;
+      p->waitstart = xticks;
     }
     release(&p->lock);
+    return 0;
   }
+  release(&p->lock);
   return -1;
 }
 
@@ -1117,7 +1381,7 @@ procdump(void)
   char *state;
 
   // printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -1129,51 +1393,71 @@ procdump(void)
   }
 }
 
+static char *statenames[] = {
+[UNUSED]    "unused",
+[SLEEPING]  "sleep",
+[RUNNABLE]  "runble",
+[RUNNING]   "run",
+[ZOMBIE]    "zombie"
+};
+
+// Fill st from p.  Fails if p is unused, or if pid is not 0
+// and p no longer has that pid.  Takes p->lock, so the
+// caller must hold no process locks.
+static int
+getstat(struct proc *p, int pid, struct procstat *st, uint xticks)
+{
+  char *state;
+
+  acquire(&p->lock);
+  if(p->state == UNUSED || (pid != 0 && p->pid != pid)){
+    release(&p->lock);
+    return -1;
+  }
+  if(p->state >= 0 && p->state < NELEM(statenames) && statenames[p->state])
+    state = statenames[p->state];
+  else
+    state = "???";
+
+  st->pid = p->pid;
+  safestrcpy(st->state, state, sizeof(st->state));
+  safestrcpy(st->command, p->name, sizeof(st->command));
+  st->ctime = p->ctime;
+  st->stime = p->stime;
+  st->etime = (p->endtime == -1) ? xticks-p->stime : p->endtime-p->stime;
+  st->size = p->sz;
+  st->utime = p->utime;
+  st->ktime = p->ktime;
+  st->priority = p->priority;
+  st->cpu_usage = p->cpu_usage;
+  st->waittime = p->waittime;
+  st->estimate = p->nextburst_estimate;
+  release(&p->lock);
+
+  st->ppid = parentpid(p);
+  return 0;
+}
+
 // Print a process listing to console with proper locks held.
 // Caution: don't invoke too often; can slow down the machine.
+// procsnapshot() is the cheap way to get the same information.
 int
 ps(void)
 {
-   static char *states[] = {
-  [UNUSED]    "unused",
-  [SLEEPING]  "sleep",
-  [RUNNABLE]  "runble",
-  [RUNNING]   "run",
-  [ZOMBIE]    "zombie"
-  };
   struct proc *p;
-  char *state;
-  int ppid, pid;
+  struct procstat st;
   uint xticks;
 
+  acquire(&tickslock);
+  xticks = ticks;
+  release(&tickslock);
+
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      release(&p->lock);
+  for(p = allproc; p; p = p->allnext){
+    if(getstat(p, 0, &st, xticks) < 0)
       continue;
-    }
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-
-    pid = p->pid;
-    release(&p->lock);
-    acquire(&wait_lock);
-    if (p->parent) {
-       acquire(&p->parent->lock);
-       ppid = p->parent->pid;
-       release(&p->parent->lock);
-    }
-    else ppid = -1;
-    release(&wait_lock);
-
-    acquire(&tickslock);
-    xticks = ticks;
-    release(&tickslock);
-
-    printf("pid=%d, ppid=%d, state=%s, cmd=%s, ctime=%d, stime=%d, etime=%d, size=%p", pid, ppid, state, p->name, p->ctime, p->stime, (p->endtime == -1) ? xticks-p->stime : p->endtime-p->stime, p->sz);
+    printf("pid=%d, ppid=%d, state=%s, cmd=%s, ctime=%d, stime=%d, etime=%d, size=%p", st.pid, st.ppid, st.state, st.command, st.ctime, st.stime, st.etime, st.size);
+    printf(", utime=%dus, ktime=%dus", (int)(st.utime/10), (int)(st.ktime/10));
     printf("\n");
   }
   return 0;
@@ -1182,69 +1466,105 @@ ps(void)
 int
 pinfo(int pid, uint64 addr)
 {
-   struct procstat pstat;
+  struct procstat pstat;
+  struct proc *p;
+  uint xticks;
 
-   static char *states[] = {
-  [UNUSED]    "unused",
-  [SLEEPING]  "sleep",
-  [RUNNABLE]  "runble",
-  [RUNNING]   "run",
-  [ZOMBIE]    "zombie"
-  };
+  if(pid == -1){
+    p = myproc();
+    pid = 0;
+  } else if((p = pidfind(pid)) == 0)
+    return -1;
+
+  acquire(&tickslock);
+  xticks = ticks;
+  release(&tickslock);
+
+  if(getstat(p, pid, &pstat, xticks) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char *)&pstat, sizeof(pstat)) < 0)
+    return -1;
+  return 0;
+}
+
+// Copy the status of up to max live processes to the user
+// array at addr in a single pass over allproc, and return
+// how many were copied.  Entries are gathered a page at a
+// time so the copyouts stay few however large the table is.
+int
+procsnapshot(uint64 addr, int max)
+{
   struct proc *p;
-  char *state;
+  struct procstat *buf;
+  int n, k, per;
   uint xticks;
-  int found=0;
 
-  if (pid == -1) {
-     p = myproc();
-     acquire(&p->lock);
-     found=1;
-  }
-  else {
-     for(p = proc; p < &proc[NPROC]; p++){
-       acquire(&p->lock);
-       if((p->state == UNUSED) || (p->pid != pid)) {
-         release(&p->lock);
-         continue;
-       }
-       else {
-         found=1;
-         break;
-       }
-     }
+  if(max < 0)
+    return -1;
+  if((buf = (struct procstat *)kalloc()) == 0)
+    return -1;
+  per = PGSIZE / sizeof(struct procstat);
+
+  acquire(&tickslock);
+  xticks = ticks;
+  release(&tickslock);
+
+  n = k = 0;
+  for(p = allproc; p && n < max; p = p->allnext){
+    if(getstat(p, 0, &buf[k], xticks) < 0)
+      continue;
+    n++;
+    if(++k == per || n == max){
+      if(copyout(myproc()->pagetable, addr, (char *)buf, k * sizeof(*buf)) < 0){
+        kfree(buf);
+        return -1;
+      }
+      addr += k * sizeof(*buf);
+      k = 0;
+    }
   }
-  if (found) {
-     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-         state = states[p->state];
-     else
-         state = "???";
-
-     pstat.pid = p->pid;
-     release(&p->lock);
-     acquire(&wait_lock);
-     if (p->parent) {
-        acquire(&p->parent->lock);
-        pstat.ppid = p->parent->pid;
-        release(&p->parent->lock);
-     }
-     else pstat.ppid = -1;
-     release(&wait_lock);
+  if(k > 0 && copyout(myproc()->pagetable, addr, (char *)buf, k * sizeof(*buf)) < 0)
+    n = -1;
+  kfree(buf);
+  return n;
+}
 
-     acquire(&tickslock);
-     xticks = ticks;
-     release(&tickslock);
+// Copy the totals of the last batch to finish to the user
+// struct at addr.  seq tells callers whether a new batch has
+// finished since they last looked.
+int
+batchstat(uint64 addr)
+{
+  struct batchstat st = lastbatch;
+
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Copy the statistics of up to max CPUs to the user array
+// at addr, and return how many were copied.  The counters
+// of other CPUs are read without a lock; they only grow.
+int
+cpustat(uint64 addr, int max)
+{
+  struct cpustat st[NCPU];
+  uint64 now;
+  int i;
 
-     safestrcpy(&pstat.state[0], state, strlen(state)+1);
-     safestrcpy(&pstat.command[0], &p->name[0], sizeof(p->name));
-     pstat.ctime = p->ctime;
-     pstat.stime = p->stime;
-     pstat.etime = (p->endtime == -1) ? xticks-p->stime : p->endtime-p->stime;
-     pstat.size = p->sz;
-     if(copyout(myproc()->pagetable, addr, (char *)&pstat, sizeof(pstat)) < 0) return -1;
-     return 0;
+  if(max < 0)
+    return -1;
+  if(max > NCPU)
+    max = NCPU;
+  now = r_time();
+  for(i = 0; i < max; i++){
+    st[i].time = now;
+    st[i].busy = cpus[i].busy;
+    st[i].nswitch = cpus[i].nswitch;
   }
-  else return -1;
+  if(copyout(myproc()->pagetable, addr, (char *)st, max * sizeof(st[0])) < 0)
+    return -1;
+  return max;
 }
 
 int
@@ -1293,9 +1613,11 @@ barrier(int inst_num, int id, int np) {
     struct barr *b = &barriers[id];
 
     acquiresleep(&b -> lock);
-    acquiresleep(&printlock);
-    printf("%d: Entered barrier#%d for barrier array id %d\n", pid, inst_num, id);
-    releasesleep(&printlock);
+    if(p->syncverbose) {
+        acquiresleep(&printlock);
+        printf("%d: Entered barrier#%d for barrier array id %d\n", pid, inst_num, id);
+        releasesleep(&printlock);
+    }
     b->processes += 1;
     if(b->processes < np) {
         // while(b->processes < np)
@@ -1305,9 +1627,11 @@ barrier(int inst_num, int id, int np) {
         cond_broadcast(&b->cv);
         b->processes = 0;
     }
-    acquiresleep(&printlock);
-    printf("%d: Finished barrier#%d for barrier array id %d\n", pid, inst_num, id);
-    releasesleep(&printlock);
+    if(p->syncverbose) {
+        acquiresleep(&printlock);
+        printf("%d: Finished barrier#%d for barrier array id %d\n", pid, inst_num, id);
+        releasesleep(&printlock);
+    }
     releasesleep(&b->lock);
 }
 
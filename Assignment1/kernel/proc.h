@@ -24,6 +24,9 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int stackgen;               // Kernel stacks mapped when TLB last flushed.
+  uint64 busy;                // time CSR counts spent running processes.
+  uint64 nswitch;             // Switches to a process.
 };
 
 extern struct cpu cpus[NCPU];
@@ -96,8 +99,20 @@ struct proc {
   int priority;		       // Dynamic priority of a process
   int is_batchproc;	       // Is it part of a batch created using forkp
 
-  // wait_lock must be held when using this:
+  // parent->kidlock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *kprev, *knext;  // Siblings in parent's kids list
+
+  struct spinlock kidlock;     // Protects kids, and the above in each kid
+  struct proc *kids;           // Children, zombies first; circular
+
+  struct proc *pidnext;        // pid hash chain; pid_lock protects it
+
+  // set when the descriptor is created, and never changed:
+  struct proc *allnext;        // Next descriptor in allproc list
+  int slot;                    // Index of kernel stack address
+
+  struct proc *freenext;       // Free list; proc_lock protects it
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -120,4 +135,10 @@ struct proc {
   int nextburst_estimate;      // s(n+1)
 
   int cpu_usage;	       // CPU usage
+
+  uint64 utime;		       // time CSR counts spent in user mode
+  uint64 ktime;		       // time CSR counts spent in kernel mode
+  uint64 tstamp;	       // When utime or ktime was last charged
+
+  int syncverbose;	       // Print consumed items and barrier progress
 };
@@ -7,4 +7,10 @@ struct procstat {
   int stime;	// Start time
   int etime;	// Execution time
   uint64 size;	// Process size
+  uint64 utime;	// User mode time, in time CSR counts
+  uint64 ktime;	// Kernel mode time, in time CSR counts
+  int priority;	// Dynamic priority
+  int cpu_usage;	// Decayed CPU usage, in ticks
+  int waittime;	// Time spent in the ready queue
+  int estimate;	// SJF estimate of the next CPU burst
 };
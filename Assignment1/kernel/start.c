@@ -46,6 +46,11 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let supervisor mode read the cycle and time counters.
+  w_mcounteren(r_mcounteren() | 3);
+  // and user mode the time counter, for cheap timestamps.
+  w_scounteren(r_scounteren() | 2);
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -6,6 +6,12 @@
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "trace.h"
+#include "sysstat.h"
+
+// Per-CPU system call counters and latency histograms,
+// updated with interrupts off so no lock is needed.
+static struct sysstat sysstats[NCPU][NSYSSTAT];
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -127,6 +133,17 @@ extern uint64 sys_buffer_sem_init(void);
 extern uint64 sys_sem_produce(void);
 extern uint64 sys_sem_consume(void);
 
+extern uint64 sys_logstat(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_setmaxproc(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_procsnapshot(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_batchstat(void);
+extern uint64 sys_syncverbose(void);
+
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
@@ -168,17 +185,88 @@ static uint64 (*syscalls[])(void) = {
 [SYS_buffer_sem_init] sys_buffer_sem_init,
 [SYS_sem_produce]  sys_sem_produce,
 [SYS_sem_consume]  sys_sem_consume,
+[SYS_logstat]  sys_logstat,
+[SYS_splice]   sys_splice,
+[SYS_readv]    sys_readv,
+[SYS_writev]   sys_writev,
+[SYS_setmaxproc] sys_setmaxproc,
+[SYS_sysstat]  sys_sysstat,
+[SYS_procsnapshot] sys_procsnapshot,
+[SYS_cpustat]  sys_cpustat,
+[SYS_batchstat] sys_batchstat,
+[SYS_syncverbose] sys_syncverbose,
 };
 
+// Account a call of system call num that took dt counts,
+// on the CPU it finished on.
+static void
+sysacct(int num, uint64 dt)
+{
+  struct sysstat *st;
+  int b;
+
+  if(num >= NSYSSTAT)
+    return;
+  for(b = 0; b < NSYSHIST-1 && (dt >> (b+1)) != 0; b++)
+    ;
+  push_off();
+  st = &sysstats[cpuid()][num];
+  st->count++;
+  st->time += dt;
+  st->hist[b]++;
+  pop_off();
+}
+
+// Copy the statistics of system calls [0, n), summed over
+// CPUs, to user address addr, and return how many were copied.
+// If addr is 0, reset the statistics instead.  The sums are
+// not a snapshot: calls may finish while they are taken.
+int
+sysstat(uint64 addr, int n)
+{
+  struct sysstat sum;
+  int i, c, b;
+
+  if(n > NSYSSTAT)
+    n = NSYSSTAT;
+  if(addr == 0){
+    for(c = 0; c < NCPU; c++)
+      for(i = 0; i < NSYSSTAT; i++){
+        push_off();
+        memset(&sysstats[c][i], 0, sizeof(sysstats[c][i]));
+        pop_off();
+      }
+    return 0;
+  }
+  for(i = 0; i < n; i++){
+    memset(&sum, 0, sizeof(sum));
+    for(c = 0; c < NCPU; c++){
+      sum.count += sysstats[c][i].count;
+      sum.time += sysstats[c][i].time;
+      for(b = 0; b < NSYSHIST; b++)
+        sum.hist[b] += sysstats[c][i].hist[b];
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(sum), (char*)&sum, sizeof(sum)) < 0)
+      return -1;
+  }
+  return n;
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 t0;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    t0 = r_time();
+    trace(TR_SYSCALL, p->pid, num, 0);
     p->trapframe->a0 = syscalls[num]();
+    t0 = r_time() - t0;
+    trace(TR_SYSRET, p->pid, num, t0);
+    sysacct(num, t0);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
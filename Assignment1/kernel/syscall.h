@@ -41,4 +41,15 @@
 
 #define SYS_buffer_sem_init      37
 #define SYS_sem_produce        38
-#define SYS_sem_consume        39
\ No newline at end of file
+#define SYS_sem_consume        39
+
+#define SYS_logstat            40
+#define SYS_splice             41
+#define SYS_readv              42
+#define SYS_writev             43
+#define SYS_setmaxproc         44
+#define SYS_sysstat            45
+#define SYS_procsnapshot       46
+#define SYS_cpustat            47
+#define SYS_batchstat          48
+#define SYS_syncverbose        49
\ No newline at end of file
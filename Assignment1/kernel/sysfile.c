@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "logstat.h"
+#include "iovec.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -218,6 +220,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_enter(dp, name, 0, 0);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -262,7 +265,7 @@ create(char *path, short type, short major, short minor)
     panic("create: ialloc");
 
   ilock(ip);
-  ip->major = major;
+  ip->major = (type == T_DIR) ? DIRHASH : major;  // new directories are hashed
   ip->minor = minor;
   ip->nlink = 1;
   iupdate(ip);
@@ -484,3 +487,78 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// Copy the file system log's counters to user space.
+uint64
+sys_logstat(void)
+{
+  uint64 addr; // user pointer to struct logstat
+  struct logstat st;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  logstat(&st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Move up to n bytes between a file and a pipe
+// without copying them through user space.
+uint64
+sys_splice(void)
+{
+  struct file *fin, *fout;
+  int n;
+
+  if(argfd(0, 0, &fin) < 0 || argfd(1, 0, &fout) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(fin, fout, n);
+}
+
+// Fetch the iovec array of a readv()/writev() call:
+// its address is argument n and its length argument n+1.
+static int
+argiov(int n, struct iovec *iov, int *niov)
+{
+  uint64 addr;
+  uint64 len = 0;
+  int i;
+
+  if(argaddr(n, &addr) < 0 || argint(n+1, niov) < 0)
+    return -1;
+  if(*niov < 0 || *niov > NIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char *)iov, addr, *niov * sizeof(*iov)) < 0)
+    return -1;
+  for(i = 0; i < *niov; i++){
+    len += iov[i].iov_len;
+    if(len > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[NIOV];
+  int niov;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &niov) < 0)
+    return -1;
+  return filereadv(f, iov, niov);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[NIOV];
+  int niov;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &niov) < 0)
+    return -1;
+  return filewritev(f, iov, niov);
+}
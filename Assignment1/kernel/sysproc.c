@@ -179,6 +179,42 @@ sys_pinfo(void)
   return pinfo(x, p);
 }
 
+uint64
+sys_procsnapshot(void)
+{
+  uint64 p;
+  int max;
+
+  if(argaddr(0, &p) < 0 || argint(1, &max) < 0)
+    return -1;
+  if(p == 0)
+    return -1;
+  return procsnapshot(p, max);
+}
+
+uint64
+sys_cpustat(void)
+{
+  uint64 p;
+  int max;
+
+  if(argaddr(0, &p) < 0 || argint(1, &max) < 0)
+    return -1;
+  if(p == 0)
+    return -1;
+  return cpustat(p, max);
+}
+
+uint64
+sys_batchstat(void)
+{
+  uint64 p;
+
+  if(argaddr(0, &p) < 0 || p == 0)
+    return -1;
+  return batchstat(p);
+}
+
 uint64
 sys_forkp(void)
 {
@@ -195,6 +231,25 @@ sys_schedpolicy(void)
   return schedpolicy(x);
 }
 
+uint64
+sys_setmaxproc(void)
+{
+  int n;
+  if(argint(0, &n) < 0) return -1;
+  return setmaxproc(n);
+}
+
+uint64
+sys_sysstat(void)
+{
+  uint64 p;
+  int n;
+
+  if(argaddr(0, &p) < 0 || argint(1, &n) < 0)
+    return -1;
+  return sysstat(p, n);
+}
+
 uint64
 sys_barrier_alloc(void)
 {
@@ -273,9 +328,11 @@ sys_cond_consume(void)
   val = buf_arr[ind].value;
   cond_signal(&buf_arr[ind].deleted);
   releasesleep(&buf_arr[ind].lock);
-  acquiresleep(&printlock);
-  printf("%d ", val);
-  releasesleep(&printlock);
+  if(myproc()->syncverbose){
+    acquiresleep(&printlock);
+    printf("%d ", val);
+    releasesleep(&printlock);
+  }
 
   return val;
 }
@@ -312,9 +369,26 @@ sys_sem_consume(void){
   sem_post(&con);
   sem_post(&empty);
 
-  acquiresleep(&printlock);
-    printf("%d ", val);
-  releasesleep(&printlock);
+  if(myproc()->syncverbose){
+    acquiresleep(&printlock);
+      printf("%d ", val);
+    releasesleep(&printlock);
+  }
 
   return val;
-}
\ No newline at end of file
+}
+
+// Turn the printing of consumed items and barrier progress
+// on or off for this process and the children it creates
+// from now on, and return the old setting.
+uint64
+sys_syncverbose(void)
+{
+  struct proc *p = myproc();
+  int x, y;
+
+  if(argint(0, &x) < 0) return -1;
+  y = p->syncverbose;
+  p->syncverbose = x;
+  return y;
+}
@@ -0,0 +1,12 @@
+// Per-system-call statistics, returned by sysstat().
+// Times are in time CSR counts (10 MHz).
+
+#define NSYSSTAT 64   // system call numbers covered
+#define NSYSHIST 24   // log2 latency buckets
+
+struct sysstat {
+  uint64 count;            // Calls
+  uint64 time;             // Total time in the call
+  uint64 hist[NSYSHIST];   // hist[i]: calls taking [2^i, 2^(i+1)) counts;
+                           // the last bucket also holds longer ones
+};
@@ -0,0 +1,138 @@
+//
+// Kernel event tracing.  Each CPU records events in its own
+// ring, with interrupts off, so recording takes no lock.
+// Reads of /dev/trace drain the rings; a reader that falls
+// NTRACE events behind loses the oldest and gets a TR_LOST
+// event instead.  Tracing is off until a '1' is
+// written to /dev/trace, and a '0' turns it off again.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+#include "trace.h"
+
+int tracing;
+
+struct tracebuf {
+  struct traceev ev[NTRACE];
+  uint64 head;  // events recorded; written only by its CPU
+  uint64 tail;  // events read; reader holds tr.lock
+};
+
+static struct {
+  struct spinlock lock;  // serializes readers
+  struct tracebuf cpu[NCPU];
+} tr;
+
+// Record an event on this CPU, if tracing.
+void
+trace(int type, int pid, uint64 a, uint64 b)
+{
+  struct tracebuf *tb;
+  struct traceev *e;
+
+  if(!tracing)
+    return;
+  push_off();
+  tb = &tr.cpu[cpuid()];
+  e = &tb->ev[tb->head % NTRACE];
+  e->time = r_time();
+  e->type = type;
+  e->cpu = cpuid();
+  e->pid = pid;
+  e->a = a;
+  e->b = b;
+  __sync_synchronize();  // event before head
+  tb->head++;
+  pop_off();
+}
+
+// Copy the next unread event of tb to *e.
+// Caller must hold tr.lock.
+// Returns 0 if there is none.
+static int
+nextev(struct tracebuf *tb, int cpu, struct traceev *e)
+{
+  uint64 head, lost;
+
+  head = tb->head;
+  __sync_synchronize();
+  if(tb->tail == head)
+    return 0;
+  if(head - tb->tail < NTRACE){
+    *e = tb->ev[tb->tail % NTRACE];
+    __sync_synchronize();
+    if(tb->head - tb->tail < NTRACE){
+      tb->tail++;
+      return 1;
+    }
+    head = tb->head;
+  }
+
+  // the oldest events were overwritten, or the CPU may be
+  // overwriting the one at tail while we copy it: with a full
+  // ring it records into that slot before advancing head.
+  // skip them, keeping at most NTRACE-1 unread.
+  lost = head - (NTRACE - 1) - tb->tail;
+  tb->tail += lost;
+  e->time = r_time();
+  e->type = TR_LOST;
+  e->cpu = cpu;
+  e->pid = 0;
+  e->a = lost;
+  e->b = 0;
+  return 1;
+}
+
+// Read whole events, from each CPU's ring in turn.
+// Never blocks; returns 0 if nothing is buffered.
+static int
+traceread(int user_dst, uint64 dst, int n)
+{
+  struct traceev e;
+  int cpu, tot = 0;
+
+  acquire(&tr.lock);
+  for(cpu = 0; cpu < NCPU; cpu++){
+    while(tot + sizeof(e) <= n && nextev(&tr.cpu[cpu], cpu, &e)){
+      if(either_copyout(user_dst, dst + tot, &e, sizeof(e)) == -1){
+        release(&tr.lock);
+        return tot;
+      }
+      tot += sizeof(e);
+    }
+  }
+  release(&tr.lock);
+  return tot;
+}
+
+// Writing '1' starts tracing and '0' stops it.
+static int
+tracewrite(int user_src, uint64 src, int n)
+{
+  char c;
+
+  if(n < 1 || either_copyin(&c, user_src, src, 1) == -1)
+    return -1;
+  if(c == '1')
+    tracing = 1;
+  else if(c == '0')
+    tracing = 0;
+  else
+    return -1;
+  return n;
+}
+
+void
+traceinit(void)
+{
+  initlock(&tr.lock, "trace");
+  devsw[TRACE].read = traceread;
+  devsw[TRACE].write = tracewrite;
+}
@@ -0,0 +1,20 @@
+// Kernel trace events, read from /dev/trace.
+struct traceev {
+  uint64 time;  // time CSR when recorded
+  ushort type;  // TR_*
+  ushort cpu;   // CPU that recorded it
+  int pid;      // process concerned, or 0
+  uint64 a;     // type-specific arguments
+  uint64 b;
+};
+
+#define TR_SWITCH    1  // scheduler runs pid; a = policy, b = tick
+#define TR_SWITCHOUT 2  // pid gives the CPU back; a = new state
+#define TR_SLEEP     3  // pid sleeps; a = chan
+#define TR_WAKEUP    4  // pid woken; a = chan
+#define TR_SYSCALL   5  // pid enters system call a
+#define TR_SYSRET    6  // pid returns from system call a; b = time spent
+#define TR_DISK      7  // disk finished block a; b = 1 if a write
+#define TR_LOST      8  // reader missed a events from this cpu
+
+#define NTRACE 512      // events buffered per CPU
@@ -38,16 +38,22 @@
 #define ReadReg(reg) (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
-// the transmit output buffer.
+// the transmit output buffer, shared by write()s to the
+// console and by kernel printf().
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 4096
 char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
+int uart_tx_waiting; // a uartwrite() sleeps for space
+
+// bytes the transmit FIFO holds once LSR_TX_IDLE is set.
+#define UART_TX_FIFO 16
 
 extern volatile int panicked; // from printf.c
 
-void uartstart();
+int uartstart();
+static int uartsend();
 
 void
 uartinit(void)
@@ -77,15 +83,17 @@ uartinit(void)
   initlock(&uart_tx_lock, "uart");
 }
 
-// add a character to the output buffer and tell the
+// add n characters to the output buffer and tell the
 // UART to start sending if it isn't already.
 // blocks if the output buffer is full.
 // because it may block, it can't be called
 // from interrupts; it's only suitable for use
 // by write().
 void
-uartputc(int c)
+uartwrite(char *s, int n)
 {
+  int i, wake = 0;
+
   acquire(&uart_tx_lock);
 
   if(panicked){
@@ -93,19 +101,78 @@ uartputc(int c)
       ;
   }
 
-  while(1){
+  for(i = 0; i < n; ){
     if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
       // buffer is full.
       // wait for uartstart() to open up space in the buffer.
-      sleep(&uart_tx_r, &uart_tx_lock);
+      wake |= uartstart();
+      if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+        // the interrupt wakes everyone waiting, us included.
+        uart_tx_waiting = 1;
+        sleep(&uart_tx_r, &uart_tx_lock);
+      }
+    } else {
+      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = s[i++];
+      uart_tx_w += 1;
+    }
+  }
+  wake |= uartstart();
+  release(&uart_tx_lock);
+  if(wake)
+    wakeup(&uart_tx_r);
+}
+
+void
+uartputc(int c)
+{
+  char ch = c;
+
+  uartwrite(&ch, 1);
+}
+
+// add n characters to the output buffer without sleeping,
+// for kernel printf(), which may run in an interrupt or
+// with any lock held.  if the buffer is full, spins sending
+// characters itself until there is space.
+void
+uartwrite_async(char *s, int n)
+{
+  int i;
+
+  acquire(&uart_tx_lock);
+  for(i = 0; i < n; ){
+    if(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      if(panicked){
+        release(&uart_tx_lock);
+        for(;;)
+          ;
+      }
+      uartsend();
     } else {
-      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = c;
+      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = s[i++];
       uart_tx_w += 1;
-      uartstart();
-      release(&uart_tx_lock);
-      return;
     }
   }
+  // no wakeup() here, which takes proc locks; a uartwrite()
+  // waiting for space is woken by the next interrupt.
+  uartsend();
+  release(&uart_tx_lock);
+}
+
+// send everything in the output buffer, spinning,
+// for panic(). takes no lock, since the holder
+// may never release it.
+void
+uartflush_sync(void)
+{
+  push_off();
+  while(uart_tx_r != uart_tx_w){
+    while((ReadReg(LSR) & LSR_TX_IDLE) == 0)
+      ;
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
+  pop_off();
 }
 
 // alternate version of uartputc() that doesn't 
@@ -130,34 +197,48 @@ uartputc_sync(int c)
   pop_off();
 }
 
-// if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// if the UART is idle, fill its transmit FIFO from
+// the transmit buffer.
+// caller must hold uart_tx_lock.
+// returns the number of characters sent.
+static int
+uartsend()
+{
+  int n;
+
+  if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
+    // the UART transmit FIFO is not empty, so we cannot
+    // tell how much room it has.
+    // it will interrupt when it's ready for more.
+    return 0;
+  }
+
+  for(n = 0; n < UART_TX_FIFO && uart_tx_r != uart_tx_w; n++){
+    WriteReg(THR, uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]);
+    uart_tx_r += 1;
+  }
+  return n;
+}
+
+// if the UART is idle, and characters are waiting
+// in the transmit buffer, send them.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
-void
+// returns 1 if a uartwrite() waiting for space should be
+// woken; the caller does that after releasing uart_tx_lock,
+// since wakeup() takes proc locks and kernel printf() takes
+// uart_tx_lock with a proc lock held.
+int
 uartstart()
 {
-  while(1){
-    if(uart_tx_w == uart_tx_r){
-      // transmit buffer is empty.
-      return;
-    }
-    
-    if((ReadReg(LSR) & LSR_TX_IDLE) == 0){
-      // the UART transmit holding register is full,
-      // so we cannot give it another byte.
-      // it will interrupt when it's ready for a new byte.
-      return;
-    }
-    
-    int c = uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE];
-    uart_tx_r += 1;
-    
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
-    WriteReg(THR, c);
+  uartsend();
+
+  // maybe uartwrite() is waiting for space in the buffer.
+  if(uart_tx_waiting && uart_tx_w != uart_tx_r + UART_TX_BUF_SIZE){
+    uart_tx_waiting = 0;
+    return 1;
   }
+  return 0;
 }
 
 // read one input character from the UART.
@@ -189,6 +270,8 @@ uartintr(void)
 
   // send buffered characters.
   acquire(&uart_tx_lock);
-  uartstart();
+  int wake = uartstart();
   release(&uart_tx_lock);
+  if(wake)
+    wakeup(&uart_tx_r);
 }
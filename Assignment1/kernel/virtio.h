@@ -43,9 +43,13 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX     29
 
-// this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// this many virtio descriptors, and so requests in flight.
+// must be a power of two, and small enough that the
+// descriptors and avail ring fit in one page.
+#define NUM 64
+
+// max blocks merged into one request.
+#define NSEG 16
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -56,6 +60,7 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT  1 // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr points to a table of descriptors
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "trace.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -35,8 +36,8 @@ static struct disk {
   // the first region of pages[] is a set (not a ring) of DMA
   // descriptors, with which the driver tells the device where to read
   // and write individual disk operations. there are NUM descriptors.
-  // most commands consist of a "chain" (a linked list) of a couple of
-  // these descriptors.
+  // every request uses exactly one of them, which points to an
+  // indirect table (below) holding the request's real chain.
   // points into pages[].
   struct virtq_desc *desc;
 
@@ -59,15 +60,24 @@ static struct disk {
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
-  // indexed by first descriptor index of chain.
+  // indexed by ring descriptor.
   struct {
-    struct buf *b;
+    struct buf *b; // bufs of the request, linked through qnext
     char status;
   } info[NUM];
 
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  // indirect descriptor tables, one per ring descriptor: a
+  // header, up to NSEG data blocks, and a 1-byte status.
+  struct virtq_desc ind[NUM][NSEG+2];
+
+  // bufs waiting for a free descriptor, linked through qnext
+  // and sorted by block number, so that runs of adjacent blocks
+  // can be merged into one request.
+  struct buf *queue;
   
   struct spinlock vdisk_lock;
   
@@ -95,13 +105,14 @@ virtio_disk_init(void)
 
   // negotiate features
   uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  if((features & (1 << VIRTIO_RING_F_INDIRECT_DESC)) == 0)
+    panic("virtio disk has no indirect descriptors");
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
@@ -126,7 +137,7 @@ virtio_disk_init(void)
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
 
   // desc = pages -- num * virtq_desc
-  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
+  // avail = pages + num * virtq_desc -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
   disk.desc = (struct virtq_desc *) disk.pages;
@@ -166,119 +177,167 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
-// free a chain of descriptors.
+// add b to the queue of bufs waiting for the disk,
+// keeping the queue sorted by block number.
+// caller holds disk.vdisk_lock.
 static void
-free_chain(int i)
+enqueue(struct buf *b, int write, int async)
 {
-  while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
-    if(flag & VRING_DESC_F_NEXT)
-      i = nxt;
-    else
-      break;
-  }
+  struct buf **pp;
+
+  b->disk = 1;
+  b->qwrite = write;
+  b->async = async;
+  for(pp = &disk.queue; *pp && (*pp)->blockno < b->blockno; pp = &(*pp)->qnext)
+    ;
+  b->qnext = *pp;
+  *pp = b;
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
-static int
-alloc3_desc(int *idx)
+// hand queued bufs to the device, one request per run of up to
+// NSEG adjacent blocks in the same direction, until the queue is
+// empty or the ring is full.  never sleeps.
+// caller holds disk.vdisk_lock.
+static void
+dispatch(void)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
+  struct buf *b, *last;
+  int d, n, started = 0;
+
+  while(disk.queue){
+    if((d = alloc_desc()) < 0)
+      break;
+
+    // take the longest mergeable run off the front of the queue.
+    b = last = disk.queue;
+    for(n = 1; n < NSEG && last->qnext &&
+          last->qnext->qwrite == b->qwrite &&
+          last->qnext->dev == b->dev &&
+          last->qnext->blockno == last->blockno + 1; n++)
+      last = last->qnext;
+    disk.queue = last->qnext;
+    last->qnext = 0;
+
+    // the spec's Section 5.2 says that legacy block operations use
+    // one descriptor for type/reserved/sector, then the data, then
+    // a 1-byte status result.  they go in d's indirect table.
+
+    struct virtio_blk_req *buf0 = &disk.ops[d];
+    struct virtq_desc *ind = disk.ind[d];
+
+    if(b->qwrite)
+      buf0->type = VIRTIO_BLK_T_OUT; // write the disk
+    else
+      buf0->type = VIRTIO_BLK_T_IN; // read the disk
+    buf0->reserved = 0;
+    buf0->sector = (uint64)b->blockno * (BSIZE / 512);
+
+    ind[0].addr = (uint64) buf0;
+    ind[0].len = sizeof(struct virtio_blk_req);
+    ind[0].flags = VRING_DESC_F_NEXT;
+    ind[0].next = 1;
+
+    int i = 1;
+    for(struct buf *x = b; x; x = x->qnext, i++){
+      ind[i].addr = (uint64) x->data;
+      ind[i].len = BSIZE;
+      if(b->qwrite)
+        ind[i].flags = 0; // device reads x->data
+      else
+        ind[i].flags = VRING_DESC_F_WRITE; // device writes x->data
+      ind[i].flags |= VRING_DESC_F_NEXT;
+      ind[i].next = i + 1;
     }
-  }
-  return 0;
-}
 
-void
-virtio_disk_rw(struct buf *b, int write)
-{
-  uint64 sector = b->blockno * (BSIZE / 512);
+    disk.info[d].status = 0xff; // device writes 0 on success
+    ind[i].addr = (uint64) &disk.info[d].status;
+    ind[i].len = 1;
+    ind[i].flags = VRING_DESC_F_WRITE; // device writes the status
+    ind[i].next = 0;
 
-  acquire(&disk.vdisk_lock);
+    disk.desc[d].addr = (uint64) ind;
+    disk.desc[d].len = (n + 2) * sizeof(struct virtq_desc);
+    disk.desc[d].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[d].next = 0;
 
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+    // record the bufs for virtio_disk_intr().
+    disk.info[d].b = b;
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
+    // tell the device the first index in our chain of descriptors.
+    disk.avail->ring[disk.avail->idx % NUM] = d;
 
-  // format the three descriptors.
-  // qemu's virtio-blk.c reads them.
-
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
-
-  if(write)
-    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
-  else
-    buf0->type = VIRTIO_BLK_T_IN; // read the disk
-  buf0->reserved = 0;
-  buf0->sector = sector;
-
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
-
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+    __sync_synchronize();
 
-  // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+    // tell the device another avail ring entry is available.
+    disk.avail->idx += 1; // not % NUM ...
 
-  __sync_synchronize();
+    started = 1;
+  }
+
+  if(started){
+    __sync_synchronize();
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  }
+}
 
-  // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+// queue a read or write of b without starting it.
+// b must stay locked until virtio_disk_wait(b) returns.
+// queueing several bufs before a virtio_disk_kick() or
+// virtio_disk_wait() lets adjacent blocks share a request.
+void
+virtio_disk_start(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  enqueue(b, write, 0);
+  release(&disk.vdisk_lock);
+}
 
-  __sync_synchronize();
+// queue a read or write of b that no one will wait for.
+// on completion virtio_disk_intr() hands b to bdone(),
+// which releases it; the caller must not touch b again.
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+  enqueue(b, write, 1);
+  release(&disk.vdisk_lock);
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// start all queued requests that fit in the ring.
+// the rest are started by virtio_disk_intr() as
+// earlier requests complete.
+void
+virtio_disk_kick(void)
+{
+  acquire(&disk.vdisk_lock);
+  dispatch();
+  release(&disk.vdisk_lock);
+}
+
+// wait for a request queued by virtio_disk_start() to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  dispatch();
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_start(b, write);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
@@ -305,11 +364,26 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    disk.info[id].b = 0;
+    free_desc(id);
+
+    while(b){
+      struct buf *next = b->qnext;
+      b->qnext = 0;
+      b->disk = 0;   // disk is done with buf
+      trace(TR_DISK, 0, b->blockno, b->qwrite);
+      if(b->async)
+        bdone(b);
+      else
+        wakeup(b);
+      b = next;
+    }
 
     disk.used_idx += 1;
   }
 
+  // start requests that were waiting for descriptors.
+  dispatch();
+
   release(&disk.vdisk_lock);
 }
@@ -0,0 +1,51 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+// qemu's timer counts at 10 MHz; a tick is TIMER_INTERVAL counts.
+#define TICKS_PER_SEC (10000000 / TIMER_INTERVAL)
+
+static void
+show(char *what, struct logstat *st, uint64 nticks)
+{
+  uint64 per10 = st->commits ? st->blocks * 10 / st->commits : 0;
+
+  printf("%s: %l commits, %l blocks, %l installs, %l.%l blocks/commit",
+         what, st->commits, st->blocks, st->installs, per10 / 10, per10 % 10);
+  if (nticks > 0)
+    printf(", %l commits/s", st->commits * TICKS_PER_SEC / nticks);
+  printf("\n");
+}
+
+// Print file system log throughput, in total and over an
+// interval of the given number of ticks (default 100).
+int
+main(int argc, char *argv[])
+{
+  struct logstat st0, st1, d;
+  int interval = 100;
+  int t0, t1;
+
+  if (argc > 1)
+    interval = atoi(argv[1]);
+
+  t0 = uptime();
+  if (logstat(&st0) < 0) {
+    fprintf(2, "logstat: cannot read log counters\n");
+    exit(1);
+  }
+  show("total", &st0, t0);
+  if (interval <= 0)
+    exit(0);
+
+  sleep(interval);
+  t1 = uptime();
+  logstat(&st1);
+  d.commits = st1.commits - st0.commits;
+  d.blocks = st1.blocks - st0.blocks;
+  d.installs = st1.installs - st0.installs;
+  show("interval", &d, t1 - t0);
+
+  exit(0);
+}
@@ -6,18 +6,154 @@
 
 static char digits[] = "0123456789ABCDEF";
 
+// Buffered streams.  stdout is line-buffered on the console
+// and fully buffered otherwise; stderr is written out at the
+// end of each call; stdin is read a bufferful at a time.
+// fork(), forkf(), forkp(), exec() and exit() flush stdout
+// and stderr first, so output is neither duplicated in a
+// child nor lost.
+static struct stream sin = { .fd = 0 }, sout = { .fd = 1 }, serr = { .fd = 2 };
+struct stream *stdin = &sin;
+struct stream *stdout = &sout;
+struct stream *stderr = &serr;
+
+static void
+setup(struct stream *s)
+{
+  struct stat st;
+
+  if(s->mode != 0)
+    return;
+  if(s == stderr)
+    s->mode = S_NONE;
+  else if(s == stdout && fstat(s->fd, &st) == 0 && st.type == T_DEVICE)
+    s->mode = S_LINE;
+  else
+    s->mode = S_FULL;
+}
+
+int
+fflush(struct stream *s)
+{
+  int n = s->n;
+
+  if(s == stdin || n == 0)
+    return 0;
+  s->n = 0;
+  return write(s->fd, s->buf, n) == n ? 0 : -1;
+}
+
+static void
+putc(struct stream *s, char c)
+{
+  s->buf[s->n++] = c;
+  if(s->n == BUFSIZ || (c == '\n' && s->mode == S_LINE))
+    fflush(s);
+}
+
+// End of a call that wrote to s.
 static void
-putc(int fd, char c)
+done(struct stream *s)
+{
+  if(s->mode == S_NONE)
+    fflush(s);
+}
+
+int
+fputc(int c, struct stream *s)
+{
+  setup(s);
+  putc(s, c);
+  done(s);
+  return c & 0xff;
+}
+
+int
+fwrite(const void *buf, int n, struct stream *s)
+{
+  const char *p = buf;
+  int i;
+
+  setup(s);
+  if(s->n + n > BUFSIZ && s->mode != S_LINE){
+    // too big to buffer; write it out directly.
+    if(fflush(s) < 0)
+      return -1;
+    return write(s->fd, buf, n);
+  }
+  for(i = 0; i < n; i++)
+    putc(s, p[i]);
+  done(s);
+  return n;
+}
+
+int
+fputs(const char *str, struct stream *s)
+{
+  return fwrite(str, strlen(str), s);
+}
+
+// Return the next byte of s, or -1 at end of file.
+int
+fgetc(struct stream *s)
+{
+  if(s->r == s->n){
+    fflush(stdout);  // show any prompt before waiting
+    s->r = 0;
+    if((s->n = read(s->fd, s->buf, BUFSIZ)) <= 0){
+      s->n = 0;
+      return -1;
+    }
+  }
+  return s->buf[s->r++] & 0xff;
+}
+
+int
+fork(void)
+{
+  fflush(stdout);
+  fflush(stderr);
+  return _fork();
+}
+
+int
+forkf(void *f)
+{
+  fflush(stdout);
+  fflush(stderr);
+  return _forkf(f);
+}
+
+int
+forkp(int priority)
+{
+  fflush(stdout);
+  fflush(stderr);
+  return _forkp(priority);
+}
+
+int
+exec(char *path, char **argv)
+{
+  fflush(stdout);
+  fflush(stderr);
+  return _exec(path, argv);
+}
+
+int
+exit(int status)
 {
-  write(fd, &c, 1);
+  fflush(stdout);
+  fflush(stderr);
+  _exit(status);
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(struct stream *o, long long xx, int base, int sgn)
 {
-  char buf[16];
+  char buf[24];
   int i, neg;
-  uint x;
+  uint64 x;
 
   neg = 0;
   if(sgn && xx < 0){
@@ -35,16 +171,16 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x) {
+printptr(struct stream *o, uint64 x) {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the given fd. Only understands %d, %x, %p, %s.
@@ -53,7 +189,21 @@ vprintf(int fd, const char *fmt, va_list ap)
 {
   char *s;
   int c, i, state;
+  struct stream tmp, *o;
 
+  if(fd == 1)
+    o = stdout;
+  else if(fd == 2){
+    fflush(stdout);  // keep the console in order
+    o = stderr;
+  } else {
+    // other descriptors are written once per call.
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.fd = fd;
+    tmp.mode = S_NONE;
+    o = &tmp;
+  }
+  setup(o);
   state = 0;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
@@ -61,37 +211,38 @@ vprintf(int fd, const char *fmt, va_list ap)
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(o, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(o, va_arg(ap, int), 10, 1);
       } else if(c == 'l') {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(o, va_arg(ap, uint64), 10, 0);
       } else if(c == 'x') {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(o, (uint)va_arg(ap, int), 16, 0);
       } else if(c == 'p') {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(o, va_arg(ap, uint64));
       } else if(c == 's'){
         s = va_arg(ap, char*);
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(o, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, va_arg(ap, uint));
+        putc(o, va_arg(ap, uint));
       } else if(c == '%'){
-        putc(fd, c);
+        putc(o, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(o, '%');
+        putc(o, c);
       }
       state = 0;
     }
   }
+  done(o);
 }
 
 void
@@ -0,0 +1,45 @@
+#include "kernel/types.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+// Take a snapshot of every live process, growing the buffer
+// until it holds them all.  Returns the count, and the
+// buffer in *bufp.
+int
+snapshot(struct procstat **bufp)
+{
+  static struct procstat *buf;
+  static int max = 64;
+  int n;
+
+  for(;;){
+    if(buf == 0 && (buf = malloc(max * sizeof(*buf))) == 0)
+      return -1;
+    if((n = procsnapshot(buf, max)) < max)
+      break;
+    free(buf);
+    buf = 0;
+    max *= 2;
+  }
+  *bufp = buf;
+  return n;
+}
+
+int
+main(void)
+{
+  struct procstat *st;
+  int i, n;
+
+  if((n = snapshot(&st)) < 0){
+    fprintf(2, "ps: cannot read process table\n");
+    exit(1);
+  }
+  printf("PID\tPPID\tSTATE\tSIZE\tUSER\tSYS\tCMD\n");
+  for(i = 0; i < n; i++)
+    printf("%d\t%d\t%s\t%dK\t%dms\t%dms\t%s\n", st[i].pid, st[i].ppid,
+           st[i].state, (int)(st[i].size / 1024),
+           (int)(st[i].utime / 10000), (int)(st[i].ktime / 10000),
+           st[i].command);
+  exit(0);
+}
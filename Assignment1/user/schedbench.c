@@ -0,0 +1,198 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/batchstat.h"
+#include "user/user.h"
+
+// Scheduler benchmark.  Runs each workload below as a batch
+// of forkp() jobs under each scheduling policy, and prints
+// the batch totals from batchstat() as CSV.
+//
+//   schedbench [policy ...]        run the benchmark
+//   schedbench -g policy workload  print a batch file for submitjobs
+//   schedbench -w kind len         run one job
+
+#define NJOBS 8
+#define SPIN 1000000   // additions in one unit of work
+
+enum { CPU, IO, BURST };
+
+char *kinds[] = { [CPU] "cpu", [IO] "io", [BURST] "burst" };
+char *policies[] = {
+[SCHED_NPREEMPT_FCFS] "fcfs",
+[SCHED_NPREEMPT_SJF]  "sjf",
+[SCHED_PREEMPT_RR]    "rr",
+[SCHED_PREEMPT_UNIX]  "unix",
+};
+char *workloads[] = { "cpu", "io", "mixed", "bursts", "prio" };
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+struct job {
+  int kind;
+  int len;
+  int prio;
+};
+
+// Job i of workload w.
+void
+mkjob(int w, int i, struct job *j)
+{
+  j->kind = CPU;
+  j->len = 20;
+  j->prio = 10;
+  switch(w){
+  case 1:                     // all sleeping between short bursts
+    j->kind = IO;
+    j->len = 10;
+    break;
+  case 2:                     // half of each
+    if(i % 2){
+      j->kind = IO;
+      j->len = 10;
+    }
+    break;
+  case 3:                     // repeated bursts, longest first
+    j->kind = BURST;
+    j->len = 16 >> (i % 4);
+    break;
+  case 4:                     // same work, spread of priorities
+    j->prio = i * 10;
+    break;
+  }
+}
+
+void
+spin(int units)
+{
+  volatile int x = 0;
+  int i;
+
+  while(units-- > 0)
+    for(i = 0; i < SPIN; i++)
+      x += i;
+}
+
+void
+work(int kind, int len)
+{
+  int i;
+
+  switch(kind){
+  case CPU:
+    spin(len);
+    break;
+  case IO:
+    for(i = 0; i < len; i++){
+      spin(1);
+      sleep(1);
+    }
+    break;
+  case BURST:
+    for(i = 0; i < 5; i++){
+      spin(len);
+      sleep(1);
+    }
+    break;
+  }
+}
+
+int
+lookup(char **names, int n, char *s)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(strcmp(names[i], s) == 0)
+      return i;
+  return -1;
+}
+
+// Run workload w as one batch and print its CSV row.
+int
+run(int policy, int w)
+{
+  struct batchstat before, st;
+  struct job j;
+  int i, n;
+
+  if(batchstat(&before) < 0)
+    return -1;
+  for(i = 0; i < NJOBS; i++){
+    mkjob(w, i, &j);
+    if((n = forkp(j.prio)) < 0)
+      return -1;
+    if(n == 0){
+      work(j.kind, j.len);
+      exit(0);
+    }
+  }
+  while(wait(0) >= 0)
+    ;
+  if(batchstat(&st) < 0 || st.seq == before.seq || st.nproc == 0)
+    return -1;
+
+  printf("%s,%s,%d,%d,%d,%d,%d,%d,%d,%d\n", policies[policy], workloads[w],
+         st.nproc, st.exectime, st.turnaround / st.nproc,
+         st.waiting / st.nproc,
+         st.exectime ? st.nproc * 6000 / st.exectime : 0,
+         st.nbursts, st.nbursts ? st.bursts / st.nbursts : 0,
+         st.nerrors ? st.error / st.nerrors : 0);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct job j;
+  int i, p, w, old;
+  int use[NELEM(policies)];
+
+  if(argc == 4 && strcmp(argv[1], "-w") == 0){
+    if((i = lookup(kinds, NELEM(kinds), argv[2])) < 0)
+      goto usage;
+    work(i, atoi(argv[3]));
+    exit(0);
+  }
+
+  if(argc == 4 && strcmp(argv[1], "-g") == 0){
+    p = atoi(argv[2]);
+    if(p < 0 || p >= NELEM(policies) ||
+       (w = lookup(workloads, NELEM(workloads), argv[3])) < 0)
+      goto usage;
+    printf("%d\n", p);
+    for(i = 0; i < NJOBS; i++){
+      mkjob(w, i, &j);
+      printf("%d schedbench -w %s %d\n", j.prio, kinds[j.kind], j.len);
+    }
+    exit(0);
+  }
+
+  for(p = 0; p < NELEM(policies); p++)
+    use[p] = (argc == 1);
+  for(i = 1; i < argc; i++){
+    p = atoi(argv[i]);
+    if(argv[i][0] < '0' || argv[i][0] > '9' || p >= NELEM(policies))
+      goto usage;
+    use[p] = 1;
+  }
+
+  printf("policy,workload,jobs,exec_ticks,avg_turnaround,avg_waiting,"
+         "jobs_per_min,bursts,avg_burst,avg_est_error\n");
+  old = schedpolicy(SCHED_NPREEMPT_FCFS);
+  for(p = 0; p < NELEM(policies); p++){
+    if(!use[p])
+      continue;
+    schedpolicy(p);
+    for(w = 0; w < NELEM(workloads); w++)
+      if(run(p, w) < 0)
+        fprintf(2, "schedbench: %s/%s failed\n", policies[p], workloads[w]);
+  }
+  schedpolicy(old);
+  exit(0);
+
+usage:
+  fprintf(2, "usage: schedbench [policy ...]\n"
+             "       schedbench -g policy workload\n"
+             "       schedbench -w cpu|io|burst len\n");
+  exit(1);
+}
@@ -0,0 +1,341 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+// Synchronisation microbenchmark.  Sweeps producer/consumer
+// counts over the condition variable and semaphore bounded
+// buffers, and participant counts over barrier(), printing
+// one CSV row per run:
+//
+//   primitive,producers,consumers,ops,ops_per_sec,p50_us,p99_us,switches_per_op
+//
+// For the buffers an op is one item and its latency is from
+// produce to consume; each producer stamps its items with the
+// time CSR.  For the barrier an op is one round and the
+// latency is from the last arrival to each participant's
+// return; consumers is the participant count.
+//
+//   syncbench [items [rounds]]
+
+#define MAXPROCS 8
+#define MASK 0x7fffffff          // item stamps are 31-bit times
+
+int oldverbose;               // syncverbose() setting to restore
+
+int counts[] = { 1, 2, 4 };
+int parts[] = { 2, 4, 8 };
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+void
+die(char *msg)
+{
+  fprintf(2, "syncbench: %s\n", msg);
+  syncverbose(oldverbose);
+  exit(1);
+}
+
+// Total context switches on all CPUs so far.
+uint64
+switches(void)
+{
+  struct cpustat st[NCPU];
+  uint64 n = 0;
+  int i;
+
+  if(cpustat(st, NCPU) < 0)
+    return 0;
+  for(i = 0; i < NCPU; i++)
+    n += st[i].nswitch;
+  return n;
+}
+
+// Read exactly n bytes from fd.
+int
+readn(int fd, void *buf, int n)
+{
+  int m, got = 0;
+
+  while(got < n){
+    if((m = read(fd, (char*)buf + got, n - got)) <= 0)
+      return -1;
+    got += m;
+  }
+  return got;
+}
+
+// Start a child running fn(arg, out, n), where out is an
+// array of n values that the parent gets back through a
+// pipe.  Returns the read end, or -1 if the child could not
+// be started; once started, it always runs fn.
+int
+spawn(void (*fn)(int, uint64*, int), int arg, int n)
+{
+  int fd[2];
+  uint64 *out;
+
+  if((out = malloc(n * sizeof(*out))) == 0)
+    return -1;
+  if(pipe(fd) < 0){
+    free(out);
+    return -1;
+  }
+  switch(fork()){
+  case -1:
+    close(fd[0]);
+    close(fd[1]);
+    free(out);
+    return -1;
+  case 0:
+    close(fd[0]);
+    fn(arg, out, n);
+    write(fd[1], out, n * sizeof(*out));
+    exit(0);
+  }
+  close(fd[1]);
+  free(out);
+  return fd[0];
+}
+
+void
+sort(uint64 *a, int n)
+{
+  int i, j, gap;
+  uint64 t;
+
+  // Shell sort; n is at most a few thousand.
+  for(gap = n / 2; gap > 0; gap /= 2)
+    for(i = gap; i < n; i++){
+      t = a[i];
+      for(j = i; j >= gap && a[j - gap] > t; j -= gap)
+        a[j] = a[j - gap];
+      a[j] = t;
+    }
+}
+
+void
+report(char *name, int np, int nc, int ops, uint64 *lat, int nlat,
+       uint64 elapsed, uint64 nswitch)
+{
+  int sw;
+
+  sort(lat, nlat);
+  if(elapsed == 0)
+    elapsed = 1;
+  sw = ops ? nswitch * 100 / ops : 0;
+  printf("%s,%d,%d,%d,%d,%d,%d,%d.%d%d\n", name, np, nc, ops,
+         (int)((uint64)ops * 10000000 / elapsed),
+         nlat ? (int)(lat[nlat / 2] / 10) : 0,
+         nlat ? (int)(lat[nlat * 99 / 100] / 10) : 0,
+         sw / 100, sw / 10 % 10, sw % 10);
+}
+
+int useSem;
+int nitems;
+
+void
+producer(int tid, uint64 *out, int n)
+{
+  int i;
+
+  for(i = 0; i < nitems; i++){
+    if(useSem)
+      sem_produce(rdtime() & MASK);
+    else
+      cond_produce(rdtime() & MASK);
+  }
+}
+
+void
+consumer(int tid, uint64 *out, int n)
+{
+  int i, v;
+
+  for(i = 0; i < n; i++){
+    v = useSem ? sem_consume() : cond_consume();
+    out[i] = (rdtime() - v) & MASK;
+  }
+}
+
+// Run np producers of nitems each against nc consumers.
+void
+buffer(int np, int nc)
+{
+  int i, n, total, got, failed, fd[MAXPROCS];
+  uint64 t0, s0, *lat;
+
+  total = np * nitems;
+  if((lat = malloc(total * sizeof(*lat))) == 0){
+    fprintf(2, "syncbench: out of memory\n");
+    return;
+  }
+  if(useSem)
+    buffer_sem_init();
+  else
+    buffer_cond_init();
+
+  s0 = switches();
+  t0 = rdtime();
+  for(i = 0; i < np; i++){
+    if((n = spawn(producer, i, 0)) < 0)
+      break;
+    close(n);
+  }
+  if(i < np){
+    // Take what the started producers put in, so they can
+    // finish, and give up on this run.
+    fprintf(2, "syncbench: cannot start producer\n");
+    consumer(0, lat, i * nitems);
+    while(wait(0) >= 0)
+      ;
+    free(lat);
+    return;
+  }
+
+  for(i = 0; i < nc; i++){
+    n = total / nc + (i < total % nc);
+    fd[i] = spawn(consumer, i, n);
+  }
+  got = failed = 0;
+  for(i = 0; i < nc; i++){
+    n = total / nc + (i < total % nc);
+    if(fd[i] < 0){
+      // Consume this share here so the producers finish.
+      consumer(i, lat + got, n);
+      failed = 1;
+    } else {
+      if(readn(fd[i], lat + got, n * sizeof(*lat)) < 0)
+        failed = 1;
+      close(fd[i]);
+    }
+    got += n;
+  }
+  while(wait(0) >= 0)
+    ;
+  if(failed)
+    fprintf(2, "syncbench: %s %d/%d failed\n", useSem ? "sem" : "cond", np, nc);
+  else
+    report(useSem ? "sem" : "cond", np, nc, total, lat, got,
+           rdtime() - t0, switches() - s0);
+  free(lat);
+}
+
+int barrierid;
+int nparts;
+int go[2];                     // participants start on a byte from here
+
+// Records (entry, exit) time pairs, one per round.  Waits for
+// the go-ahead first, and gives up if the pipe is closed
+// instead, because not everyone could be started.
+void
+participant(int tid, uint64 *out, int n)
+{
+  int r;
+  char c;
+
+  close(go[1]);
+  if(read(go[0], &c, 1) != 1)
+    exit(1);
+  close(go[0]);
+  for(r = 0; r < n / 2; r++){
+    out[2*r] = rdtime();
+    barrier(r, barrierid, nparts);
+    out[2*r+1] = rdtime();
+  }
+}
+
+// Run np participants through rounds barriers.
+void
+barriers(int np, int rounds)
+{
+  int i, r, failed, fd[MAXPROCS];
+  uint64 t0, s0, last, *lat, *times[MAXPROCS];
+
+  if((barrierid = barrier_alloc()) < 0){
+    fprintf(2, "syncbench: no barrier\n");
+    return;
+  }
+  nparts = np;
+  if((lat = malloc(np * rounds * sizeof(*lat))) == 0){
+    fprintf(2, "syncbench: out of memory\n");
+    barrier_free(barrierid);
+    return;
+  }
+  for(i = 0; i < np; i++)
+    if((times[i] = malloc(2 * rounds * sizeof(uint64))) == 0)
+      die("out of memory");
+
+  if(pipe(go) < 0)
+    die("cannot make pipe");
+  failed = 0;
+  for(i = 0; i < np; i++)
+    if((fd[i] = spawn(participant, i, 2 * rounds)) < 0)
+      failed = 1;
+
+  // A barrier only opens when all np have arrived, so start
+  // nobody unless everyone is there; closing the pipe sends
+  // them home.
+  s0 = switches();
+  t0 = rdtime();
+  if(!failed)
+    for(i = 0; i < np; i++)
+      write(go[1], "g", 1);
+  close(go[0]);
+  close(go[1]);
+  for(i = 0; i < np; i++){
+    if(fd[i] < 0)
+      continue;
+    if(!failed && readn(fd[i], times[i], 2 * rounds * sizeof(uint64)) < 0)
+      failed = 1;
+    close(fd[i]);
+  }
+  while(wait(0) >= 0)
+    ;
+  t0 = rdtime() - t0;
+  if(failed){
+    fprintf(2, "syncbench: barrier %d failed\n", np);
+    goto out;
+  }
+
+  for(r = 0; r < rounds; r++){
+    last = 0;
+    for(i = 0; i < np; i++)
+      if(times[i][2*r] > last)
+        last = times[i][2*r];
+    for(i = 0; i < np; i++)
+      lat[r*np + i] = times[i][2*r+1] > last ? times[i][2*r+1] - last : 0;
+  }
+  report("barrier", 0, np, rounds, lat, np * rounds, t0, switches() - s0);
+
+out:
+  for(i = 0; i < np; i++)
+    free(times[i]);
+  free(lat);
+  barrier_free(barrierid);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, rounds;
+
+  nitems = argc > 1 ? atoi(argv[1]) : 200;
+  rounds = argc > 2 ? atoi(argv[2]) : 100;
+  if(argc > 3 || nitems <= 0 || rounds <= 0){
+    fprintf(2, "usage: syncbench [items [rounds]]\n");
+    exit(1);
+  }
+
+  oldverbose = syncverbose(0);
+  printf("primitive,producers,consumers,ops,ops_per_sec,p50_us,p99_us,"
+         "switches_per_op\n");
+  for(useSem = 0; useSem < 2; useSem++)
+    for(i = 0; i < NELEM(counts); i++)
+      for(j = 0; j < NELEM(counts); j++)
+        buffer(counts[i], counts[j]);
+  for(i = 0; i < NELEM(parts); i++)
+    barriers(parts[i], rounds);
+  syncverbose(oldverbose);
+  exit(0);
+}
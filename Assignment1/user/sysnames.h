@@ -0,0 +1,62 @@
+// System call names, by number, for the tools that report
+// on system calls.  Include after kernel/syscall.h.
+
+static char *sysnames[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_getppid] "getppid",
+[SYS_yield]   "yield",
+[SYS_getpa]   "getpa",
+[SYS_forkf]   "forkf",
+[SYS_waitpid] "waitpid",
+[SYS_ps]      "ps",
+[SYS_pinfo]   "pinfo",
+[SYS_forkp]   "forkp",
+[SYS_schedpolicy] "schedpolicy",
+[SYS_barrier_alloc] "barrier_alloc",
+[SYS_barrier] "barrier",
+[SYS_barrier_free] "barrier_free",
+[SYS_buffer_cond_init] "buffer_cond_init",
+[SYS_cond_produce] "cond_produce",
+[SYS_cond_consume] "cond_consume",
+[SYS_buffer_sem_init] "buffer_sem_init",
+[SYS_sem_produce] "sem_produce",
+[SYS_sem_consume] "sem_consume",
+[SYS_logstat] "logstat",
+[SYS_splice]  "splice",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_setmaxproc] "setmaxproc",
+[SYS_sysstat] "sysstat",
+[SYS_procsnapshot] "procsnapshot",
+[SYS_cpustat] "cpustat",
+[SYS_batchstat] "batchstat",
+[SYS_syncverbose] "syncverbose",
+};
+
+static char*
+sysname(uint64 n)
+{
+  if(n < sizeof(sysnames)/sizeof(sysnames[0]) && sysnames[n])
+    return sysnames[n];
+  return "?";
+}
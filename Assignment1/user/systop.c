@@ -0,0 +1,74 @@
+#include "kernel/types.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+#include "user/sysnames.h"
+
+#define NTOP 10
+
+struct sysstat st[NSYSSTAT];
+
+// Upper bound, in microseconds, of the latency below which
+// fraction num/den of the calls of s finished.
+static int
+percentile(struct sysstat *s, int num, int den)
+{
+  uint64 seen = 0;
+  int b;
+
+  for(b = 0; b < NSYSHIST; b++){
+    seen += s->hist[b];
+    if(seen * den >= s->count * num)
+      break;
+  }
+  return (2L << b) / 10;
+}
+
+// Print the system calls that took the most time in total,
+// either since boot (or the last reset) or while running
+// the given command.
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, pid, best;
+  int done[NSYSSTAT];
+  struct sysstat *s;
+
+  if(argc > 1){
+    sysstat(0, 0);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "systop: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "systop: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if((n = sysstat(st, NSYSSTAT)) < 0){
+    fprintf(2, "systop: cannot read statistics\n");
+    exit(1);
+  }
+
+  for(i = 0; i < n; i++)
+    done[i] = 0;
+  for(j = 0; j < NTOP; j++){
+    best = -1;
+    for(i = 0; i < n; i++)
+      if(!done[i] && st[i].count > 0 && (best < 0 || st[i].time > st[best].time))
+        best = i;
+    if(best < 0)
+      break;
+    done[best] = 1;
+    s = &st[best];
+    printf("%s: calls %d, total %dus, avg %dus, p50 <%dus, p99 <%dus\n",
+           sysname(best), (int)s->count, (int)(s->time / 10),
+           (int)(s->time / 10 / s->count),
+           percentile(s, 1, 2), percentile(s, 99, 100));
+  }
+  exit(0);
+}
@@ -0,0 +1,139 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/procstat.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+#define NTOP 20
+
+struct sample {
+  struct procstat *ps;
+  int max;
+  int n;
+  uint64 run[NTOP];             // run time over the interval, for shown procs
+  struct cpustat cpu[NCPU];
+};
+
+struct sample samples[2];
+char done[NPROCMAX];
+
+// Fill s with the state of every process and CPU.
+int
+take(struct sample *s)
+{
+  if(s->max == 0)
+    s->max = 64;
+  for(;;){
+    if(s->ps == 0 && (s->ps = malloc(s->max * sizeof(s->ps[0]))) == 0)
+      return -1;
+    if((s->n = procsnapshot(s->ps, s->max)) < s->max)
+      break;
+    free(s->ps);
+    s->ps = 0;
+    s->max *= 2;
+  }
+  if(s->n < 0 || cpustat(s->cpu, NCPU) < 0)
+    return -1;
+  return 0;
+}
+
+// Time run by st since sample s was taken.
+uint64
+ran(struct procstat *st, struct sample *s)
+{
+  int i;
+
+  for(i = 0; i < s->n; i++)
+    if(s->ps[i].pid == st->pid)
+      return st->utime + st->ktime - s->ps[i].utime - s->ps[i].ktime;
+  return st->utime + st->ktime;
+}
+
+void
+show(struct sample *old, struct sample *cur)
+{
+  uint64 elapsed, busy, run;
+  struct procstat *st;
+  int i, j, best, shown[NTOP];
+
+  elapsed = cur->cpu[0].time - old->cpu[0].time;
+  if(elapsed == 0)
+    elapsed = 1;
+
+  printf("\033[H\033[J");
+  for(i = 0; i < NCPU; i++){
+    if(cur->cpu[i].nswitch == 0)
+      continue;
+    busy = cur->cpu[i].busy - old->cpu[i].busy;
+    printf("cpu%d: %d%% busy, %d switches/s\n", i,
+           (int)(busy * 100 / elapsed),
+           (int)((cur->cpu[i].nswitch - old->cpu[i].nswitch) * 10000000 / elapsed));
+  }
+  printf("%d processes\n\n", cur->n);
+
+  // Pick the processes that ran the most.
+  for(i = 0; i < cur->n && i < NPROCMAX; i++)
+    done[i] = 0;
+  for(j = 0; j < NTOP; j++){
+    best = -1;
+    for(i = 0; i < cur->n && i < NPROCMAX; i++){
+      if(done[i])
+        continue;
+      run = ran(&cur->ps[i], old);
+      if(best < 0 || run > cur->run[j]){
+        best = i;
+        cur->run[j] = run;
+      }
+    }
+    if(best < 0)
+      break;
+    done[best] = 1;
+    shown[j] = best;
+  }
+
+  printf("PID\tSTATE\tPRIO\tCPU%%\tUSAGE\tWAIT\tEST\tCMD\n");
+  for(i = 0; i < j; i++){
+    st = &cur->ps[shown[i]];
+    printf("%d\t%s\t%d\t%d\t%d\t%d\t%d\t%s\n", st->pid, st->state,
+           st->priority, (int)(cur->run[i] * 100 / elapsed),
+           st->cpu_usage, st->waittime, st->estimate, st->command);
+  }
+}
+
+// Show the busiest processes and the load on each CPU every
+// delay ticks, count times or until killed.
+int
+main(int argc, char *argv[])
+{
+  int i, delay = 100, count = -1, cur = 0;
+
+  for(i = 1; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "-d") == 0)
+      delay = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      count = atoi(argv[i+1]);
+    else
+      break;
+  }
+  if(i < argc || delay <= 0){
+    fprintf(2, "usage: top [-d ticks] [-n count]\n");
+    exit(1);
+  }
+
+  if(take(&samples[cur]) < 0){
+    fprintf(2, "top: cannot read statistics\n");
+    exit(1);
+  }
+  while(count != 0){
+    sleep(delay);
+    if(take(&samples[!cur]) < 0){
+      fprintf(2, "top: cannot read statistics\n");
+      exit(1);
+    }
+    show(&samples[cur], &samples[!cur]);
+    cur = !cur;
+    if(count > 0)
+      count--;
+  }
+  exit(0);
+}
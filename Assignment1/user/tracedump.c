@@ -0,0 +1,119 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+#include "user/sysnames.h"
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+#define TRACEDEV "/dev/trace"
+
+static char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+// Print one event; times are in timer counts (10 MHz)
+// since the first event printed.
+static void
+show(struct traceev *e, uint64 t0)
+{
+  printf("%d %d ", (int)(e->time - t0), e->cpu);
+  switch(e->type){
+  case TR_SWITCH:
+    printf("switch pid %d policy %d tick %d\n", e->pid, (int)e->a, (int)e->b);
+    break;
+  case TR_SWITCHOUT:
+    printf("switchout pid %d %s\n", e->pid,
+           e->a < NELEM(states) ? states[e->a] : "?");
+    break;
+  case TR_SLEEP:
+    printf("sleep pid %d chan %p\n", e->pid, e->a);
+    break;
+  case TR_WAKEUP:
+    printf("wakeup pid %d chan %p\n", e->pid, e->a);
+    break;
+  case TR_SYSCALL:
+    printf("syscall pid %d %s\n", e->pid, sysname(e->a));
+    break;
+  case TR_SYSRET:
+    printf("sysret pid %d %s %d\n", e->pid, sysname(e->a), (int)e->b);
+    break;
+  case TR_DISK:
+    printf("disk %s block %d\n", e->b ? "write" : "read", (int)e->a);
+    break;
+  case TR_LOST:
+    printf("lost %d events\n", (int)e->a);
+    break;
+  default:
+    printf("type %d pid %d\n", e->type, e->pid);
+  }
+}
+
+// Read everything buffered in the trace device,
+// printing it if print is set.
+static void
+dump(int fd, int print)
+{
+  struct traceev ev[32];
+  uint64 t0 = 0;
+  int i, n;
+
+  while((n = read(fd, ev, sizeof(ev))) > 0){
+    for(i = 0; print && i < n / sizeof(ev[0]); i++){
+      if(t0 == 0)
+        t0 = ev[i].time;
+      show(&ev[i], t0);
+    }
+  }
+}
+
+// tracedump on|off: start or stop kernel tracing.
+// tracedump command [args]: trace command, then print the events.
+// tracedump: print the events buffered so far.
+int
+main(int argc, char *argv[])
+{
+  int fd, pid;
+
+  if((fd = open(TRACEDEV, O_RDWR)) < 0){
+    mkdir("/dev");
+    mknod(TRACEDEV, TRACE, 0);
+    if((fd = open(TRACEDEV, O_RDWR)) < 0){
+      fprintf(2, "tracedump: cannot open %s\n", TRACEDEV);
+      exit(1);
+    }
+  }
+
+  if(argc == 2 && strcmp(argv[1], "on") == 0){
+    write(fd, "1", 1);
+    exit(0);
+  }
+  if(argc == 2 && strcmp(argv[1], "off") == 0){
+    write(fd, "0", 1);
+    exit(0);
+  }
+
+  if(argc > 1){
+    dump(fd, 0);  // discard older events
+    write(fd, "1", 1);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "tracedump: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fd);
+      exec(argv[1], argv + 1);
+      fprintf(2, "tracedump: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+    write(fd, "0", 1);
+  }
+  dump(fd, 1);
+  exit(0);
+}
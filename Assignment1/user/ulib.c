@@ -55,12 +55,10 @@ strchr(const char *s, char c)
 char*
 gets(char *buf, int max)
 {
-  int i, cc;
-  char c;
+  int i, c;
 
   for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
+    if((c = fgetc(stdin)) < 0)
       break;
     buf[i++] = c;
     if(c == '\n' || c == '\r')
@@ -134,3 +132,12 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Read the time CSR, which counts at 10 MHz.
+uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
@@ -1,17 +1,22 @@
 struct stat;
 struct rtcdate;
 struct procstat;
+struct cpustat;
+struct batchstat;
+struct logstat;
+struct iovec;
+struct sysstat;
 
 // system calls
-int fork(void);
-int exit(int) __attribute__((noreturn));
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
 int write(int, const void*, int);
 int read(int, void*, int);
 int close(int);
 int kill(int);
-int exec(char*, char**);
+int _exec(char*, char**);
 int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
@@ -28,12 +33,18 @@ int uptime(void);
 int getppid(void);
 int yield(void);
 uint64 getpa(void*);
-int forkf(void*);
+int _forkf(void*);
 int waitpid(int, int*);
 int ps(void);
 int pinfo(int, struct procstat*);
-int forkp(int);
+int procsnapshot(struct procstat*, int);
+int cpustat(struct cpustat*, int);
+int batchstat(struct batchstat*);
+int syncverbose(int);
+int _forkp(int);
 int schedpolicy(int);
+int setmaxproc(int);
+int sysstat(struct sysstat*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -43,6 +54,11 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
+int fork(void);
+int forkf(void*);
+int forkp(int);
+int exec(char*, char**);
+int exit(int) __attribute__((noreturn));
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
@@ -51,6 +67,7 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 rdtime(void);
 
 int barrier_alloc(void);
 void barrier(int, int, int);
@@ -63,3 +80,29 @@ int cond_consume(void);
 void buffer_sem_init(void);
 void sem_produce(int);
 int sem_consume(void);
+
+int logstat(struct logstat*);
+int splice(int, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+
+// printf.c: buffered streams
+#define BUFSIZ 512
+#define S_FULL 1   // flush when the buffer fills
+#define S_LINE 2   // flush at each newline, too
+#define S_NONE 3   // flush at the end of each call
+
+struct stream {
+  int fd;
+  int mode;        // S_*, or 0 until first used
+  int n;           // bytes in buf
+  int r;           // input: bytes of buf consumed
+  char buf[BUFSIZ];
+};
+
+extern struct stream *stdin, *stdout, *stderr;
+int fflush(struct stream*);
+int fputc(int, struct stream*);
+int fputs(const char*, struct stream*);
+int fwrite(const void*, int, struct stream*);
+int fgetc(struct stream*);
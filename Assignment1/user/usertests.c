@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/iovec.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -569,6 +570,10 @@ writetest(char *s)
   }
 }
 
+// enough blocks to need the double-indirect block,
+// but far fewer than MAXFILE, which exceeds FSSIZE.
+#define BIGFILE (NDIRECT + NINDIRECT + 2*NINDIRECT)
+
 void
 writebig(char *s)
 {
@@ -580,7 +585,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGFILE; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -600,7 +605,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != BIGFILE){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -780,6 +785,289 @@ pipe1(char *s)
 }
 
 
+// read all of fd into buf (at most max bytes); returns the count.
+int
+readall(int fd, char *b, int max)
+{
+  int n, tot = 0;
+
+  while(tot < max && (n = read(fd, b + tot, max - tot)) > 0)
+    tot += n;
+  return tot;
+}
+
+// splice() between a file and a pipe, in both directions,
+// up to end of file, with a closed read end, and racing
+// ordinary pipe writes.
+void
+splice1(char *s)
+{
+  enum { SZ = 10000 };
+  int fds[2], fd, pid, xstatus, i, n, na, nb;
+
+  fd = open("splicef", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create splicef\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write splicef failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // file -> pipe, asking for more than the file holds.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    memset(buf, 0, SZ);
+    if((n = readall(fds[0], buf, BUFSZ)) != SZ){
+      printf("%s: read %d bytes from the pipe\n", s, n);
+      exit(1);
+    }
+    for(i = 0; i < SZ; i++)
+      if((buf[i] & 0xff) != i % 251){
+        printf("%s: bad byte %d from the pipe\n", s, i);
+        exit(1);
+      }
+    exit(0);
+  }
+  close(fds[0]);
+  fd = open("splicef", O_RDONLY);
+  if((n = splice(fd, fds[1], 2*SZ)) != SZ){
+    printf("%s: file to pipe splice returned %d\n", s, n);
+    exit(1);
+  }
+  if(splice(fd, fds[1], 100) != 0){
+    printf("%s: splice at end of file not 0\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  // pipe -> file, racing the writer, up to its close.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    close(fds[0]);
+    for(i = 0; i < SZ; i += n){
+      n = SZ - i < 333 ? SZ - i : 333;
+      if(write(fds[1], buf + i, n) != n){
+        printf("%s: pipe write failed\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  unlink("splicef2");
+  fd = open("splicef2", O_CREATE | O_RDWR);
+  if((n = splice(fds[0], fd, 2*SZ)) != SZ){
+    printf("%s: pipe to file splice returned %d\n", s, n);
+    exit(1);
+  }
+  if(splice(fds[0], fd, 100) != 0){
+    printf("%s: splice from a closed pipe not 0\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fd);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  fd = open("splicef2", O_RDONLY);
+  memset(buf, 0, SZ);
+  if((n = readall(fd, buf, BUFSZ)) != SZ){
+    printf("%s: splicef2 has %d bytes\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    if((buf[i] & 0xff) != i % 251){
+      printf("%s: bad byte %d in splicef2\n", s, i);
+      exit(1);
+    }
+  close(fd);
+
+  // a splice and a write() into the same pipe.
+  fd = open("splicef", O_RDONLY);
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    close(fds[0]);
+    memset(buf, 'A', SZ);
+    for(i = 0; i < SZ; i += 100)
+      if(write(fds[1], buf, 100) != 100){
+        printf("%s: racing write failed\n", s);
+        exit(1);
+      }
+    exit(0);
+  }
+  if(fork() == 0){
+    close(fds[0]);
+    if(splice(fd, fds[1], SZ) != SZ){
+      printf("%s: racing splice failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  close(fd);
+  close(fds[1]);
+  n = readall(fds[0], buf, BUFSZ);
+  na = 0;
+  for(i = 0; i < n; i++)
+    na += buf[i] == 'A';
+  nb = n - na;
+  close(fds[0]);
+  for(i = 0; i < 2; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  // the file holds a few 'A' bytes of its own (65 % 251).
+  if(n != 2*SZ || na < SZ || nb < SZ - SZ/251 - 1){
+    printf("%s: racing pipe got %d bytes, %d of them A\n", s, n, na);
+    exit(1);
+  }
+
+  // a pipe with no reader, and two files.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  fd = open("splicef", O_RDONLY);
+  if(splice(fd, fds[1], 100) != -1){
+    printf("%s: splice to a pipe with no reader succeeded\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  i = open("splicef2", O_RDWR);
+  if(splice(fd, i, 100) != -1){
+    printf("%s: splice between two files succeeded\n", s);
+    exit(1);
+  }
+  close(i);
+  close(fd);
+  unlink("splicef");
+  unlink("splicef2");
+}
+
+// readv() and writev() on files and pipes, with buffers that
+// don't line up with each other, and too many buffers.
+void
+rwv(char *s)
+{
+  enum { SZ = 8000 };
+  struct iovec iov[NIOV+1];
+  static char out[SZ];
+  int fds[2], fd, pid, xstatus, i, n;
+
+  for(i = 0; i < SZ; i++)
+    out[i] = i % 253;
+
+  // one writev() of SZ bytes, too big for one log transaction.
+  unlink("rwvf");
+  fd = open("rwvf", O_CREATE | O_RDWR);
+  iov[0].iov_base = out;
+  iov[0].iov_len = 1;
+  iov[1].iov_base = out + 1;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = out + 1;
+  iov[2].iov_len = 4999;
+  iov[3].iov_base = out + 5000;
+  iov[3].iov_len = SZ - 5000;
+  if((n = writev(fd, iov, 4)) != SZ){
+    printf("%s: writev returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("rwvf", O_RDONLY);
+  memset(buf, 0, SZ);
+  for(i = 0; i < 8; i++){
+    iov[i].iov_base = buf + i * (SZ/8);
+    iov[i].iov_len = SZ/8;
+  }
+  if((n = readv(fd, iov, 8)) != SZ){
+    printf("%s: readv returned %d\n", s, n);
+    exit(1);
+  }
+  if(memcmp(buf, out, SZ) != 0){
+    printf("%s: readv data differs\n", s);
+    exit(1);
+  }
+  iov[0].iov_len = 10;
+  if(readv(fd, iov, 1) != 0){
+    printf("%s: readv at end of file not 0\n", s);
+    exit(1);
+  }
+  if(readv(fd, iov, NIOV+1) != -1 || writev(1, iov, NIOV+1) != -1){
+    printf("%s: more than NIOV buffers accepted\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwvf");
+
+  // the same through a pipe.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid == 0){
+    close(fds[0]);
+    iov[0].iov_base = out;
+    iov[0].iov_len = 3000;
+    iov[1].iov_base = out + 3000;
+    iov[1].iov_len = SZ - 3000;
+    if(writev(fds[1], iov, 2) != SZ){
+      printf("%s: pipe writev failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  memset(buf, 0, SZ);
+  n = 0;
+  while(n < SZ){
+    iov[0].iov_base = buf + n;
+    iov[0].iov_len = (SZ - n) / 2;
+    iov[1].iov_base = buf + n + (SZ - n) / 2;
+    iov[1].iov_len = SZ - n - (SZ - n) / 2;
+    if((i = readv(fds[0], iov, 2)) <= 0)
+      break;
+    n += i;
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(n != SZ || memcmp(buf, out, SZ) != 0){
+    printf("%s: pipe readv got %d bytes\n", s, n);
+    exit(1);
+  }
+}
+
+
 // test if child is killed (status = -1)
 void
 killstatus(char *s)
@@ -1553,6 +1841,112 @@ bigdir(char *s)
   }
 }
 
+// a directory made by mkdir is hashed: fill it past block 0
+// into the bucket chains, and check lookups, the entries a
+// plain read of the directory sees, and when it counts as
+// empty, as entries come and go.
+void
+hashdir(char *s)
+{
+  enum { N = 300 };
+  int i, fd, n;
+  char name[10];
+  struct dirent de;
+
+  unlink("hd/f");
+  unlink("hd");
+  if(mkdir("hd") != 0){
+    printf("%s: mkdir hd failed\n", s);
+    exit(1);
+  }
+  fd = open("hd/f", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create hd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  name[0] = 'h'; name[1] = 'd'; name[2] = '/'; name[3] = 'x';
+  name[6] = '\0';
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 64;
+    name[5] = '0' + i % 64;
+    if(link("hd/f", name) != 0){
+      printf("%s: link(hd/f, %s) failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 64;
+    name[5] = '0' + i % 64;
+    if(link("hd/f", name) == 0){
+      printf("%s: second link %s succeeded\n", s, name);
+      exit(1);
+    }
+  }
+  if(open("hd/nonexistent", O_RDONLY) >= 0){
+    printf("%s: opened a missing name\n", s);
+    exit(1);
+  }
+
+  // table and link slots must read as free entries.
+  fd = open("hd", O_RDONLY);
+  n = 0;
+  while(read(fd, &de, sizeof(de)) == sizeof(de))
+    if(de.inum != 0)
+      n++;
+  close(fd);
+  if(n != N + 3){
+    printf("%s: hd has %d entries, not %d\n", s, n, N + 3);
+    exit(1);
+  }
+
+  // remove all but the last, which lives in a bucket block.
+  for(i = 0; i < N - 1; i++){
+    name[4] = '0' + i / 64;
+    name[5] = '0' + i % 64;
+    if(unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  unlink("hd/f");
+  if(unlink("hd") == 0){
+    printf("%s: unlinked hd with an entry left\n", s);
+    exit(1);
+  }
+  name[4] = '0' + (N - 1) / 64;
+  name[5] = '0' + (N - 1) % 64;
+  if((fd = open(name, O_RDONLY)) < 0){
+    printf("%s: %s lost\n", s, name);
+    exit(1);
+  }
+  close(fd);
+  if(unlink(name) != 0){
+    printf("%s: unlink %s failed\n", s, name);
+    exit(1);
+  }
+
+  // freed slots are found again.
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 64;
+    name[5] = '0' + i % 64;
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf("%s: recreate %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    if(unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(unlink("hd") != 0){
+    printf("%s: unlink of empty hd failed\n", s);
+    exit(1);
+  }
+}
+
 void
 subdir(char *s)
 {
@@ -1758,6 +2152,54 @@ bigwrite(char *s)
   }
 }
 
+// a large write from a bad address must not clobber the
+// blocks it would have overwritten.
+void
+badwrite2(char *s)
+{
+  int fd, i, n;
+
+  unlink("badwrite2");
+  fd = open("badwrite2", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create badwrite2\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', BUFSZ);
+  if(write(fd, buf, BUFSZ) != BUFSZ){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("badwrite2", O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot open badwrite2\n", s);
+    exit(1);
+  }
+  n = write(fd, (char*)0xffffffffffLL, BUFSZ);
+  if(n > 0){
+    printf("%s: write from bad address returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("badwrite2", O_RDONLY);
+  memset(buf, 0, BUFSZ);
+  if(read(fd, buf, BUFSZ) != BUFSZ){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < BUFSZ; i++){
+    if(buf[i] != 'a'){
+      printf("%s: byte %d clobbered\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("badwrite2");
+}
+
 // concurrent writes to try to provoke deadlock in the virtio disk
 // driver.
 void
@@ -2827,6 +3269,7 @@ main(int argc, char *argv[])
     {copyinstr2, "copyinstr2"},
     {copyinstr3, "copyinstr3"},
     {rwsbrk, "rwsbrk" },
+    {badwrite2, "badwrite2"},
     {truncate1, "truncate1"},
     {truncate2, "truncate2"},
     {truncate3, "truncate3"},
@@ -2871,6 +3314,8 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {splice1, "splice1"},
+    {rwv, "rwv"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
@@ -2880,7 +3325,8 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
-    {bigdir, "bigdir"}, // slow
+    {bigdir, "bigdir"},
+    {hashdir, "hashdir"}, // slow
     { 0, 0},
   };
 
@@ -6,24 +6,27 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry(name[, symbol]): the stub is called symbol if given,
+# for system calls that ulib wraps.
 sub entry {
     my $name = shift;
-    print ".global $name\n";
-    print "${name}:\n";
+    my $sym = shift || $name;
+    print ".global $sym\n";
+    print "${sym}:\n";
     print " li a7, SYS_${name}\n";
     print " ecall\n";
     print " ret\n";
 }
 	
-entry("fork");
-entry("exit");
+entry("fork", "_fork");
+entry("exit", "_exit");
 entry("wait");
 entry("pipe");
 entry("read");
 entry("write");
 entry("close");
 entry("kill");
-entry("exec");
+entry("exec", "_exec");
 entry("open");
 entry("mknod");
 entry("unlink");
@@ -40,11 +43,11 @@ entry("uptime");
 entry("getppid");
 entry("yield");
 entry("getpa");
-entry("forkf");
+entry("forkf", "_forkf");
 entry("waitpid");
 entry("ps");
 entry("pinfo");
-entry("forkp");
+entry("forkp", "_forkp");
 entry("schedpolicy");
 entry("barrier_alloc");
 entry("barrier");
@@ -54,4 +57,14 @@ entry("cond_produce");
 entry("cond_consume");
 entry("buffer_sem_init");
 entry("sem_produce");
-entry("sem_consume");
\ No newline at end of file
+entry("sem_consume");
+entry("logstat");
+entry("splice");
+entry("readv");
+entry("writev");
+entry("setmaxproc");
+entry("sysstat");
+entry("procsnapshot");
+entry("cpustat");
+entry("batchstat");
+entry("syncverbose");
\ No newline at end of file